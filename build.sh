@@ -1,3 +1,31 @@
 #!/bin/sh
 
-gcc -Iinclude -Idependencies src/*.c dependencies/wren.o -lm -o ggwren
+# Extensions named in GG_STATIC (e.g. GG_STATIC="sqlite3 sodium") are compiled from
+# extsrc/<name>/main.c and linked into the executable; pass the libraries they need in
+# GG_STATIC_LIBS (e.g. GG_STATIC_LIBS="-lsqlite3 -lsodium").
+static_objects=""
+static_list=""
+for ext in $GG_STATIC; do
+    gcc -c -fPIC -Iinclude -Idependencies -DGG_STATIC_EXT=$ext extsrc/$ext/main.c \
+        -o dependencies/$ext.static.o || exit 1
+    static_objects="$static_objects dependencies/$ext.static.o"
+    static_list="$static_list _($ext)"
+done
+
+if [ "$1" = "lib" ]; then
+    # libggwren.a and libggwren.so for embedding (see include/libggwren.h); the same sources
+    # without main(). Link Wren and -lm -pthread -ldl alongside. Only the libggwren.h API is
+    # exported; extensions reach the rest through the GG_ABI table.
+    mkdir -p dependencies/lib || exit 1
+    for src in src/*.c; do
+        gcc -c -fPIC -fvisibility=hidden -DGG_LIBRARY -Iinclude -Idependencies \
+            ${static_list:+"-DGG_STATIC_EXTENSIONS(_)=$static_list"} "$src" \
+            -o dependencies/lib/$(basename "$src" .c).o || exit 1
+    done
+    ar rcs libggwren.a dependencies/lib/*.o $static_objects || exit 1
+    gcc -shared -o libggwren.so dependencies/lib/*.o $static_objects $GG_STATIC_LIBS -lm -pthread
+    exit $?
+fi
+
+gcc -Iinclude -Idependencies ${static_list:+"-DGG_STATIC_EXTENSIONS(_)=$static_list"} src/*.c \
+    $static_objects dependencies/wren.o $GG_STATIC_LIBS -lm -pthread -o ggwren
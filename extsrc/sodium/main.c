@@ -89,10 +89,86 @@ void apiStatic_sodium_needsRehash_3(WrenVM* vm) {
     }
 }
 
+// The async variants copy their arguments, since the work runs on a host thread after the
+// foreign method has returned.
+typedef struct PasswordWork PasswordWork;
+struct PasswordWork {
+    char hashtext[crypto_pwhash_STRBYTES];
+    char *passwd;
+    int passwdlen;
+    unsigned long long opslimit;
+    size_t memlimit;
+    int result;
+};
+
+static PasswordWork* newPasswordWork(WrenVM* vm, int passwdSlot) {
+    PasswordWork* work = calloc(1, sizeof(PasswordWork));
+    const char* passwd = wrenGetSlotBytes(vm, passwdSlot, &work->passwdlen);
+    work->passwd = malloc(work->passwdlen + 1);
+    memcpy(work->passwd, passwd, work->passwdlen);
+    return work;
+}
+
+static void freePasswordWork(PasswordWork* work) {
+    sodium_memzero(work->passwd, work->passwdlen);
+    free(work->passwd);
+    free(work);
+}
+
+static void hashWork(void* data) {
+    PasswordWork* work = data;
+    work->result = crypto_pwhash_str(work->hashtext, work->passwd, work->passwdlen,
+            work->opslimit, work->memlimit);
+}
+
+static void hashComplete(WrenVM* vm, void* data) {
+    PasswordWork* work = data;
+    if (vm && (work->result == 0)) {
+        wrenSetSlotString(vm, 0, work->hashtext);
+    } else if (vm) {
+        abortSodium(vm);
+    }
+    freePasswordWork(work);
+}
+
+void apiStatic_sodium_hashAsync_4(WrenVM* vm) {
+    if (sodium_available) {
+        PasswordWork* work = newPasswordWork(vm, 2);
+        work->opslimit = (unsigned long long)wrenGetSlotDouble(vm, 3);
+        work->memlimit = (size_t)wrenGetSlotDouble(vm, 4);
+        if (!ggSubmitWork(vm, 1, &hashWork, &hashComplete, work)) freePasswordWork(work);
+    } else {
+        abortNoSodium(vm);
+    }
+}
+
+static void verifyWork(void* data) {
+    PasswordWork* work = data;
+    work->result = crypto_pwhash_str_verify(work->hashtext, work->passwd, work->passwdlen);
+}
+
+static void verifyComplete(WrenVM* vm, void* data) {
+    PasswordWork* work = data;
+    if (vm) wrenSetSlotBool(vm, 0, work->result == 0);
+    freePasswordWork(work);
+}
+
+void apiStatic_sodium_verifyAsync_3(WrenVM* vm) {
+    if (sodium_available) {
+        PasswordWork* work = newPasswordWork(vm, 3);
+        strncpy(work->hashtext, wrenGetSlotString(vm, 2), crypto_pwhash_STRBYTES - 1);
+        if (!ggSubmitWork(vm, 1, &verifyWork, &verifyComplete, work)) freePasswordWork(work);
+    } else {
+        abortNoSodium(vm);
+    }
+}
+
 void ggExt_init(void) {
     if (sodium_init() != -1) sodium_available = true;
 
     ggRegisterMethod("PasswordHash", "static hash(_,_,_)", &apiStatic_sodium_hash_3);
     ggRegisterMethod("PasswordHash", "static verify(_,_)", &apiStatic_sodium_verify_2);
     ggRegisterMethod("PasswordHash", "static needsRehash(_,_,_)", &apiStatic_sodium_needsRehash_3);
+    ggRegisterMethod("PasswordHash", "static hashAsync_(_,_,_,_)", &apiStatic_sodium_hashAsync_4);
+    ggRegisterMethod("PasswordHash", "static verifyAsync_(_,_,_)", &apiStatic_sodium_verifyAsync_3);
 }
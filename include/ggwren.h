@@ -1,7 +1,16 @@
 #ifndef GGWREN_H
 #define GGWREN_H
 
-#ifndef GG_HOST
+// Define GG_STATIC_EXT as the extension's name (e.g. -DGG_STATIC_EXT=sqlite3) to compile it for
+// linking into the ggwren executable rather than as a .ggwren.so. The Wren API is then called
+// directly instead of through GG_ABI, and ggExt_init/ggExt_finish are renamed so several
+// extensions can be linked together. See "Static Extensions" in INSTALL.md.
+#if defined(GG_STATIC_EXT) && !defined(GG_HOST)
+#define GG_STATIC_LINKED
+#include <wren.h>
+#endif
+
+#if !defined(GG_HOST) && !defined(GG_STATIC_LINKED)
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -28,6 +37,18 @@ typedef enum WrenType WrenType;
 
 typedef const char WrenByte;
 
+// Entries are only ever appended to GG_ABI_ENTRIES, bumping GG_ABI_VERSION, so an extension built
+// against an older ggwren.h sees the start of the table it expects. Extensions built with this
+// header export ggExt_abiVersion, and hosts refuse extensions newer than they are.
+#define GG_ABI_VERSION                 3
+
+// ggSubmitWork(..) runs `work` on a host thread, where it must not touch the VM, then `complete`
+// on the VM's thread once Wren asks for the result; `complete` leaves the result (or an abort) in
+// slot 0. If the result is never asked for, `complete` is called with a NULL `vm` so that it can
+// free `data`. See std.work.
+typedef void (*ggWorkFn)(void *data);
+typedef void (*ggCompleteFn)(WrenVM *vm, void *data);
+
 #define GG_ABI_ENTRIES(_) \
 /*Return type  Name                  Parameters with types                      Params w/o types */\
 _(int,         wrenGetVersionNumber, (void),                                    ()                )\
@@ -65,7 +86,29 @@ _(void,        ggRegisterClass,      (const char *name, WrenForeignMethodFn allo
                                           WrenFinalizerFn finalize),            (name, allocate,   \
                                                                                      finalize)    )\
 _(void,        ggRegisterMethod,     (const char *cls, const char *sig,                            \
-                                          WrenForeignMethodFn fn),              (cls, sig, fn)    )
+                                          WrenForeignMethodFn fn),              (cls, sig, fn)    )\
+/* Version 2 */                                                                                    \
+_(bool,        ggGetListNums,        (WrenVM *vm, int list, int start, int count,                  \
+                                          double *nums),                        (vm, list, start,  \
+                                                                                     count, nums) )\
+_(bool,        ggSetListNums,        (WrenVM *vm, int list, int start, int count,                  \
+                                          const double *nums),                  (vm, list, start,  \
+                                                                                     count, nums) )\
+_(bool,        ggMoveListRange,      (WrenVM *vm, int list, int dest, int src,                     \
+                                          int count),                           (vm, list, dest,   \
+                                                                                     src, count)  )\
+_(void,        ggSetSlotNewListSized,(WrenVM *vm, int slot, int count),         (vm, slot, count) )\
+_(void,        ggSetSlotNewMapSized, (WrenVM *vm, int slot, int count),         (vm, slot, count) )\
+_(void,        ggGetSlotDoubles,     (WrenVM *vm, int first, int count,                            \
+                                          double *nums),                        (vm, first, count, \
+                                                                                     nums)        )\
+_(void,        ggSetSlotDoubles,     (WrenVM *vm, int first, int count,                            \
+                                          const double *nums),                  (vm, first, count, \
+                                                                                     nums)        )\
+/* Version 3 */                                                                                    \
+_(bool,        ggSubmitWork,         (WrenVM *vm, int job, ggWorkFn work,                          \
+                                          ggCompleteFn complete, void *data),   (vm, job, work,    \
+                                                                                  complete, data) )
 
 typedef struct GG_ABI GG_ABI;
 struct GG_ABI {
@@ -81,9 +124,31 @@ typedef void (*ggExt_FinishFn)(void);
 
 #define GG_BOOTSTRAP_OK                0
 
-#ifndef GG_HOST
+#if !defined(GG_HOST) && defined(GG_STATIC_LINKED)
+
+#define GG_STATIC_NAME_(prefix, name, suffix) prefix##name##suffix
+#define GG_STATIC_NAME(prefix, name, suffix) GG_STATIC_NAME_(prefix, name, suffix)
+#define ggExt_init GG_STATIC_NAME(ggStatic_, GG_STATIC_EXT, _init)
+#define ggExt_finish GG_STATIC_NAME(ggStatic_, GG_STATIC_EXT, _finish)
+
+void ggExt_init(void);
+void ggExt_finish(void);
+
+void ggRegisterClass(const char *name, WrenForeignMethodFn allocate, WrenFinalizerFn finalize);
+void ggRegisterMethod(const char *cls, const char *sig, WrenForeignMethodFn fn);
+bool ggGetListNums(WrenVM *vm, int list, int start, int count, double *nums);
+bool ggSetListNums(WrenVM *vm, int list, int start, int count, const double *nums);
+bool ggMoveListRange(WrenVM *vm, int list, int dest, int src, int count);
+void ggSetSlotNewListSized(WrenVM *vm, int slot, int count);
+void ggSetSlotNewMapSized(WrenVM *vm, int slot, int count);
+void ggGetSlotDoubles(WrenVM *vm, int first, int count, double *nums);
+void ggSetSlotDoubles(WrenVM *vm, int first, int count, const double *nums);
+bool ggSubmitWork(WrenVM *vm, int job, ggWorkFn work, ggCompleteFn complete, void *data);
+
+#elif !defined(GG_HOST)
 
 int ggExt_bootstrap(GG_ABI* abi);
+extern const int ggExt_abiVersion;
 extern GG_ABI* ggABI;
 
 void ggExt_init(void);
@@ -106,6 +171,7 @@ static WrenType wrenGetSlotType(WrenVM *vm, int slot) {
 #ifdef GG_EXT_IMPLEMENTATION
 
 GG_ABI* ggABI = NULL;
+const int ggExt_abiVersion = GG_ABI_VERSION;
 int ggExt_bootstrap(GG_ABI* abi) {
     ggABI = abi;
     return GG_BOOTSTRAP_OK;
@@ -0,0 +1,65 @@
+#ifndef LIBGGWREN_H
+#define LIBGGWREN_H
+
+// Embedding GGWren. Build libggwren with `./build.sh lib` and link it together with Wren, then
+// create a runtime per script (or per group of scripts that should share globals):
+//
+//     GGRuntime *runtime = ggNewRuntime();
+//     if (ggRunModule(runtime, "app.main") != WREN_RESULT_SUCCESS) {
+//         fprintf(stderr, "%s", ggRuntimeError(runtime));
+//     }
+//     ggFreeRuntime(runtime);
+//
+// Each runtime is a separate WrenVM with its own heap and error state, and may be used from any
+// one thread at a time. Module search paths, bound extensions and the module index are shared by
+// every runtime in the process.
+
+#include <stdbool.h>
+
+#include <wren.h>
+
+typedef struct GGRuntime GGRuntime;
+
+// libggwren.so is built with -fvisibility=hidden; only the functions below are exported.
+#if defined(GG_LIBRARY) && defined(__GNUC__)
+#define GG_EXPORT __attribute__((visibility("default")))
+#else
+#define GG_EXPORT
+#endif
+
+// Set the GGWren installation directory, whose lib/ and bin/ hold the standard library and
+// extensions. It defaults to the directory containing libggwren.so (or the program, when linked
+// statically). Returns false if called after any of the functions below.
+GG_EXPORT bool ggSetHome(const char *dir);
+
+// Add a module search path, searched before the standard ones. Returns false once a runtime has
+// imported a module, since remembered module locations refer to the search paths.
+GG_EXPORT bool ggAddSearchPath(const char *path);
+
+// Set what Process.arguments returns. The strings are not copied.
+GG_EXPORT void ggSetArguments(int count, char **arguments);
+
+GG_EXPORT GGRuntime* ggNewRuntime(void);
+GG_EXPORT void ggFreeRuntime(GGRuntime *runtime);
+
+// For setting up slots and handles with the Wren API before ggCallHandle(..).
+GG_EXPORT WrenVM* ggRuntimeVM(GGRuntime *runtime);
+
+// Import `module` from the search paths, running its top level if it has not run yet. Names
+// containing quotes, backslashes, `%` or control characters are rejected as a compile error.
+GG_EXPORT WrenInterpretResult ggRunModule(GGRuntime *runtime, const char *module);
+
+// Run `source` as the module `module`.
+GG_EXPORT WrenInterpretResult ggRunSource(GGRuntime *runtime, const char *module,
+        const char *source);
+
+// wrenCall(..) on the runtime's VM.
+GG_EXPORT WrenInterpretResult ggCallHandle(GGRuntime *runtime, WrenHandle *method);
+
+// The error report (compile errors or runtime error and stack trace) from the last failed call.
+GG_EXPORT const char* ggRuntimeError(GGRuntime *runtime);
+
+// Finish and unload every extension. Call once, after freeing every runtime.
+GG_EXPORT void ggShutdown(void);
+
+#endif
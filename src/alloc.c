@@ -0,0 +1,221 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// The allocator handed to Wren through WrenConfiguration.reallocateFn. Every block carries a
+// small header recording its size class and requested size, since Wren never tells us the old
+// size when it reallocates or frees. Blocks up to the largest size class are carved out of
+// slabs and recycled through per-class free lists; anything bigger goes straight to the system
+// allocator. The header is kept in "system" mode as well, so the statistics mean the same thing
+// whichever allocator is selected.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+#include "gg.h"
+
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct AllocHeader AllocHeader;
+struct AllocHeader {
+    uint32_t sizeClass;
+    uint32_t reserved;
+    size_t size;
+};
+
+typedef struct FreeBlock FreeBlock;
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+typedef struct Slab Slab;
+struct Slab {
+    Slab *next;
+    size_t padding;
+};
+
+static const uint32_t sizeClassSizes[ALLOCATOR_SIZE_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 768, 1024, 1536, 2048
+};
+
+// Maps (size + 15) / 16 to the smallest size class that fits. Built once, before the first
+// allocator is set up; isolates set theirs up on their own threads.
+static uint8_t sizeClassLookup[2048 / 16 + 1];
+static pthread_once_t sizeClassLookupOnce = PTHREAD_ONCE_INIT;
+
+static void buildSizeClassLookup(void) {
+    int sizeClass = 0;
+    for (size_t i = 0; i < sizeof(sizeClassLookup); i ++) {
+        while (sizeClassSizes[sizeClass] < i * 16) sizeClass ++;
+        sizeClassLookup[i] = sizeClass;
+    }
+}
+
+static inline uint32_t sizeClassFor(size_t size) {
+    if (size > sizeClassSizes[ALLOCATOR_SIZE_CLASSES - 1]) return ALLOCATOR_LARGE;
+    return sizeClassLookup[(size + 15) / 16];
+}
+
+size_t allocatorClassSize(int sizeClass) {
+    return (sizeClass < ALLOCATOR_SIZE_CLASSES) ? sizeClassSizes[sizeClass] : 0;
+}
+
+void initAllocator(Allocator *allocator, AllocatorKind kind) {
+    pthread_once(&sizeClassLookupOnce, &buildSizeClassLookup);
+    memset(allocator, 0, sizeof(Allocator));
+    allocator->kind = kind;
+}
+
+void finishAllocator(Allocator *allocator) {
+    Slab *next;
+    for (Slab *slab = allocator->slabs; slab; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    allocator->slabs = NULL;
+    memset(allocator->freeLists, 0, sizeof(allocator->freeLists));
+    memset(allocator->slabCursors, 0, sizeof(allocator->slabCursors));
+    memset(allocator->slabEnds, 0, sizeof(allocator->slabEnds));
+}
+
+static void countAllocation(Allocator *allocator, uint32_t sizeClass, size_t size) {
+    allocator->allocations ++;
+    allocator->liveBytes += size;
+    if (allocator->liveBytes > allocator->peakBytes) allocator->peakBytes = allocator->liveBytes;
+    allocator->classes[sizeClass].live ++;
+    allocator->classes[sizeClass].liveBytes += size;
+    allocator->classes[sizeClass].allocations ++;
+}
+
+static void countFree(Allocator *allocator, uint32_t sizeClass, size_t size) {
+    allocator->frees ++;
+    allocator->liveBytes -= size;
+    allocator->classes[sizeClass].live --;
+    allocator->classes[sizeClass].liveBytes -= size;
+}
+
+static void countResize(Allocator *allocator, uint32_t sizeClass, size_t oldSize, size_t newSize) {
+    allocator->liveBytes = allocator->liveBytes - oldSize + newSize;
+    if (allocator->liveBytes > allocator->peakBytes) allocator->peakBytes = allocator->liveBytes;
+    allocator->classes[sizeClass].liveBytes = allocator->classes[sizeClass].liveBytes - oldSize
+            + newSize;
+}
+
+static AllocHeader* takeSlabBlock(Allocator *allocator, uint32_t sizeClass) {
+    FreeBlock *block = allocator->freeLists[sizeClass];
+    if (block) {
+        allocator->freeLists[sizeClass] = block->next;
+        return (AllocHeader*)block;
+    }
+    size_t blockSize = sizeof(AllocHeader) + sizeClassSizes[sizeClass];
+    if ((size_t)(allocator->slabEnds[sizeClass] - allocator->slabCursors[sizeClass]) < blockSize) {
+        Slab *slab = malloc(SLAB_SIZE);
+        if (!slab) return NULL;
+        slab->next = allocator->slabs;
+        allocator->slabs = slab;
+        allocator->reservedBytes += SLAB_SIZE;
+        allocator->slabCursors[sizeClass] = (char*)slab + sizeof(Slab);
+        allocator->slabEnds[sizeClass] = (char*)slab + SLAB_SIZE;
+    }
+    AllocHeader *header = (AllocHeader*)allocator->slabCursors[sizeClass];
+    allocator->slabCursors[sizeClass] += blockSize;
+    return header;
+}
+
+static void* allocateBlock(Allocator *allocator, size_t size) {
+    uint32_t sizeClass = sizeClassFor(size);
+    AllocHeader *header;
+    if ((allocator->kind == ALLOCATOR_SLAB) && (sizeClass != ALLOCATOR_LARGE)) {
+        header = takeSlabBlock(allocator, sizeClass);
+    } else {
+        header = malloc(sizeof(AllocHeader) + size);
+    }
+    if (!header) return NULL;
+    header->sizeClass = sizeClass;
+    header->size = size;
+    countAllocation(allocator, sizeClass, size);
+    return header + 1;
+}
+
+static void freeBlock(Allocator *allocator, AllocHeader *header) {
+    uint32_t sizeClass = header->sizeClass;
+    countFree(allocator, sizeClass, header->size);
+    if ((allocator->kind == ALLOCATOR_SLAB) && (sizeClass != ALLOCATOR_LARGE)) {
+        FreeBlock *block = (FreeBlock*)header;
+        block->next = allocator->freeLists[sizeClass];
+        allocator->freeLists[sizeClass] = block;
+    } else {
+        free(header);
+    }
+}
+
+void* ggReallocate(void *memory, size_t newSize, void *userData) {
+    Allocator *allocator = userData;
+    if (!memory) {
+        return (newSize > 0) ? allocateBlock(allocator, newSize) : NULL;
+    }
+    AllocHeader *header = (AllocHeader*)memory - 1;
+    if (newSize == 0) {
+        freeBlock(allocator, header);
+        return NULL;
+    }
+    uint32_t oldClass = header->sizeClass;
+    uint32_t newClass = sizeClassFor(newSize);
+    if ((allocator->kind == ALLOCATOR_SYSTEM) ||
+        ((oldClass == ALLOCATOR_LARGE) && (newClass == ALLOCATOR_LARGE)))
+    {
+        // The block comes from malloc(..) and stays there, so let realloc(..) resize it in place
+        // where it can.
+        size_t oldSize = header->size;
+        header = realloc(header, sizeof(AllocHeader) + newSize);
+        if (!header) return NULL;
+        if (newClass == oldClass) {
+            countResize(allocator, newClass, oldSize, newSize);
+        } else {
+            countFree(allocator, oldClass, oldSize);
+            countAllocation(allocator, newClass, newSize);
+        }
+        header->sizeClass = newClass;
+        header->size = newSize;
+        return header + 1;
+    }
+    if (newClass == oldClass) {
+        // The slab block is already big enough for the whole size class.
+        countResize(allocator, newClass, header->size, newSize);
+        header->size = newSize;
+        return header + 1;
+    }
+    void *result = allocateBlock(allocator, newSize);
+    if (!result) return NULL;
+    memcpy(result, memory, (header->size < newSize) ? header->size : newSize);
+    freeBlock(allocator, header);
+    return result;
+}
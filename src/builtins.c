@@ -24,7 +24,14 @@
 
 /**************************************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
@@ -37,10 +44,15 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 extern char **environ;
@@ -311,9 +323,141 @@ void apiStatic_Process_exit_1(WrenVM* vm) {
 
 static
 void apiStatic_Process_system_1(WrenVM* vm) {
+    flushOutput();
     wrenSetSlotDouble(vm, 0, (double)system(wrenGetSlotString(vm,1)));
 }
 
+static
+void apiStatic_Process_workerCount_getter(WrenVM* vm) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    wrenSetSlotDouble(vm, 0, (workerCount > 0) ? workerCount : (cpus > 0) ? cpus : 1);
+}
+
+static volatile sig_atomic_t supervisorStopSignal = 0;
+
+static void supervisorSignalHandler(int signal) {
+    supervisorStopSignal = signal;
+}
+
+// Pass a SIGTERM or SIGINT the supervisor has received on to every live worker, once. Returns
+// whether the supervisor is stopping.
+static bool forwardStopSignal(const pid_t *pids, int count, bool stopping) {
+    if (!supervisorStopSignal || stopping) return stopping;
+    for (int i = 0; i < count; i ++) {
+        if (pids[i] > 0) (void)kill(pids[i], supervisorStopSignal);
+    }
+    return true;
+}
+
+// Fork worker `index`. In the worker this restores default signal handling and, if asked, pins
+// the process to one CPU.
+static pid_t forkWorker(int index, bool pin) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        if (pin) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(index % ((cpus > 0) ? cpus : 1), &set);
+            (void)sched_setaffinity(0, sizeof(set), &set);
+        }
+    }
+    return pid;
+}
+
+// Process.fork(count, pin) returns the worker index (0 to count-1) in each worker. The calling
+// process becomes a supervisor and never returns to Wren: it restarts workers that crash or
+// exit with a non-zero code, forwards SIGTERM/SIGINT to them, and exits once all of them
+// have exited cleanly.
+static
+void apiStatic_Process_fork_2(WrenVM* vm) {
+    int count = (int)wrenGetSlotDouble(vm, 1);
+    bool pin = wrenGetSlotBool(vm, 2);
+    if (count < 1) {
+        wrenSetSlotString(vm, 0, "Process.fork(..) needs at least one worker.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    // Anything still buffered would otherwise be written once per worker.
+    flushOutput();
+    fflush(stdout);
+    fflush(stderr);
+    pid_t *pids = calloc(count, sizeof(pid_t));
+    uint64_t *startTimes = calloc(count, sizeof(uint64_t));
+    for (int i = 0; i < count; i ++) {
+        pids[i] = forkWorker(i, pin);
+        if (pids[i] == 0) {
+            free(pids);
+            free(startTimes);
+            wrenSetSlotDouble(vm, 0, i);
+            return;
+        } else if (pids[i] < 0) {
+            int e = errno;
+            for (int j = 0; j < i; j ++) (void)kill(pids[j], SIGTERM);
+            free(pids);
+            free(startTimes);
+            abortErrno(vm, e);
+            return;
+        }
+        startTimes[i] = (uint64_t)time(NULL);
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = &supervisorSignalHandler;
+    sigemptyset(&action.sa_mask);
+    (void)sigaction(SIGTERM, &action, NULL);
+    (void)sigaction(SIGINT, &action, NULL);
+
+    int running = count;
+    int exitCode = 0;
+    bool stopping = false;
+    while (running > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        stopping = forwardStopSignal(pids, count, stopping);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int index = -1;
+        for (int i = 0; i < count; i ++) {
+            if (pids[i] == pid) index = i;
+        }
+        if (index < 0) continue;
+        pids[index] = 0;    // Reaped, so it must not be signalled any more.
+        bool crashed = WIFSIGNALED(status) || (WIFEXITED(status) && (WEXITSTATUS(status) != 0));
+        if (crashed && !stopping) {
+            fprintf(stderr, WARNING "Worker %d (pid %d) %s %d; restarting it.\n", index,
+                    (int)pid, WIFSIGNALED(status) ? "was killed by signal" : "exited with code",
+                    WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+            // Don't spin if the worker dies straight away every time.
+            if ((uint64_t)time(NULL) - startTimes[index] < 1) sleep(1);
+            // A stop signal may have arrived during the sleep.
+            stopping = forwardStopSignal(pids, count, stopping);
+        }
+        if (crashed && !stopping) {
+            pids[index] = forkWorker(index, pin);
+            if (pids[index] == 0) {
+                free(pids);
+                free(startTimes);
+                wrenSetSlotDouble(vm, 0, index);
+                return;
+            } else if (pids[index] > 0) {
+                startTimes[index] = (uint64_t)time(NULL);
+                continue;
+            }
+            pids[index] = 0;
+        }
+        if (WIFEXITED(status) && (WEXITSTATUS(status) > exitCode)) exitCode = WEXITSTATUS(status);
+        running --;
+    }
+    free(pids);
+    free(startTimes);
+    exit(exitCode);
+}
+
 typedef struct File File;
 struct File {
     int fd;
@@ -624,10 +768,45 @@ void apiStatic_Time_hpc_getter(WrenVM* vm) {
 void apiStatic_Time_hpcResolution_getter(WrenVM* vm) {
     wrenSetSlotDouble(vm, 0, 100000000.0f);
 }
+
+// The buffered methods of TcpStream and UnixStream (readExact(..) and friends, see
+// std.io.stream) keep received bytes that haven't been taken yet, and queued bytes that haven't
+// been sent yet, in these. Consumed space at the front is reclaimed when it reaches half the
+// buffer, so every byte is copied a bounded number of times.
+#define SOCKET_READ_CHUNK 16384
+#define SOCKET_HIGH_WATERMARK 65536
+
+typedef struct SocketBuffers SocketBuffers;
+struct SocketBuffers {
+    Buffer in;
+    size_t inStart;         // Offset of the first untaken byte of `in`.
+    size_t inScanned;       // No delimiter was found in [inStart, inScanned) by takeUntil_(..).
+    Buffer out;
+    size_t outStart;        // Offset of the first unsent byte of `out`.
+    size_t highWatermark;
+    size_t lowWatermark;
+    bool eof;
+};
+
+// The foreign data of every socket class. `fd` must stay first: the original socket methods
+// treat the data as a plain int.
+typedef struct Socket Socket;
+struct Socket {
+    int fd;
+    SocketBuffers *buffers; // NULL until a buffered method is first used.
+};
+
+static int *newSocket(WrenVM *vm) {
+    Socket *socket = wrenSetSlotNewForeign(vm, 0, 0, sizeof(Socket));
+    socket->fd = -1;
+    socket->buffers = NULL;
+    return &socket->fd;
+}
+
 void apiAllocate_TcpListener(WrenVM* vm) {
     bool ok = true;
     int gaiResult = 0;
-    int* listener = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* listener = newSocket(vm);
     struct addrinfo *res = NULL;
     *listener = socket(AF_INET, SOCK_STREAM, 0);
     if (*listener < 0) ok = false;
@@ -671,9 +850,14 @@ void apiAllocate_TcpListener(WrenVM* vm) {
 }
 
 void apiFinalize_socket(void* data) {
-    int* sock = data;
-    if (*sock >= 0) {
-        (void)close(*sock);
+    Socket* socket = data;
+    if (socket->fd >= 0) {
+        (void)close(socket->fd);
+    }
+    if (socket->buffers) {
+        free(socket->buffers->in.bytes);
+        free(socket->buffers->out.bytes);
+        free(socket->buffers);
     }
 }
 
@@ -728,7 +912,7 @@ void api_socket_fd_getter(WrenVM* vm) {
 }
 
 void apiAllocate_TcpStream(WrenVM* vm) {
-    int* sock = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* sock = newSocket(vm);
 
     /*@todo*/
 }
@@ -771,7 +955,7 @@ void api_TcpStream_peerPort_getter(WrenVM* vm) {
 void apiStatic_TcpStream_connect_2(WrenVM* vm) {
     bool ok = true;
     int gaiResult = 0;
-    int* sock = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* sock = newSocket(vm);
     struct addrinfo *res = NULL;
     *sock = socket(AF_INET, SOCK_STREAM, 0);
     if (*sock < 0) ok = false;
@@ -810,7 +994,7 @@ void apiStatic_socket_acceptFrom_1(WrenVM* vm) {
     int* listener = wrenGetSlotForeign(vm, 1);
     int clientFd = accept(*listener, NULL, NULL);
     if (clientFd >= 0) {
-        int* client = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+        int* client = newSocket(vm);
         *client = clientFd;
     } else if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
         wrenSetSlotNull(vm, 0);
@@ -821,7 +1005,7 @@ void apiStatic_socket_acceptFrom_1(WrenVM* vm) {
 
 void apiAllocate_UnixListener(WrenVM* vm) {
     bool ok = true;
-    int* listener = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* listener = newSocket(vm);
     const char* path = wrenGetSlotString(vm, 1);
     struct sockaddr_un *addr = NULL;
     *listener = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -855,9 +1039,19 @@ void apiAllocate_UnixListener(WrenVM* vm) {
     }
 }
 
+static void takeSocketBytes(WrenVM *vm, SocketBuffers *buffers, size_t count);
+static ssize_t flushSocket(Socket *socket);
+
 void api_socket_read_1(WrenVM* vm) {
     int* sock = wrenGetSlotForeign(vm, 0);
     size_t count = (size_t)wrenGetSlotDouble(vm, 1);
+    SocketBuffers *buffers = ((Socket*)sock)->buffers;
+    if (buffers && (buffers->in.count > buffers->inStart)) {
+        // Bytes already received by a buffered method come first.
+        size_t buffered = buffers->in.count - buffers->inStart;
+        takeSocketBytes(vm, buffers, (count < buffered) ? count : buffered);
+        return;
+    }
     char buf[count];
     ssize_t bytes_read = read(*sock, buf, count);
     if (bytes_read >= 0) {
@@ -870,12 +1064,12 @@ void api_socket_read_1(WrenVM* vm) {
 }
 
 void apiAllocate_UnixStream(WrenVM* vm) {
-    int* sock = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* sock = newSocket(vm);
 }
 
 void apiStatic_UnixStream_connect_1(WrenVM* vm) {
     bool ok = true;
-    int* sock = wrenSetSlotNewForeign(vm, 0, 0, sizeof(int));
+    int* sock = newSocket(vm);
     const char* path = wrenGetSlotString(vm, 1);
     struct sockaddr_un *addr = NULL;
     *sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -899,10 +1093,38 @@ void apiStatic_UnixStream_connect_1(WrenVM* vm) {
     }
 }
 
+// pair() returns two UnixStreams connected to each other (see socketpair(2)).
+void apiStatic_UnixStream_pair_0(WrenVM* vm) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        abortErrno(vm, errno);
+        return;
+    }
+    wrenEnsureSlots(vm, 3);
+    for (int i = 0; i < 2; i ++) {
+        Socket *socket = wrenSetSlotNewForeign(vm, i + 1, 0, sizeof(Socket));
+        socket->fd = fds[i];
+        socket->buffers = NULL;
+    }
+    wrenSetSlotNewList(vm, 0);
+    wrenInsertInList(vm, 0, -1, 1);
+    wrenInsertInList(vm, 0, -1, 2);
+}
+
 void api_socket_write_1(WrenVM* vm) {
     int* sock = wrenGetSlotForeign(vm, 0);
     int count;
     const char* bytes = wrenGetSlotBytes(vm, 1, &count);
+    SocketBuffers *buffers = ((Socket*)sock)->buffers;
+    if (buffers && (buffers->out.count > buffers->outStart)) {
+        // Don't let these bytes overtake ones queued by writeAll(..).
+        ssize_t remaining = flushSocket((Socket*)sock);
+        if (remaining != 0) {
+            if (remaining < 0) abortErrno(vm, errno);
+            else wrenSetSlotNull(vm, 0);
+            return;
+        }
+    }
     ssize_t bytes_written = write(*sock, bytes, count);
     if (bytes_written >= 0) {
         wrenSetSlotDouble(vm, 0, (double)bytes_written);
@@ -913,16 +1135,210 @@ void api_socket_write_1(WrenVM* vm) {
     }
 }
 
+static SocketBuffers *getSocketBuffers(Socket *socket) {
+    if (!socket->buffers) {
+        socket->buffers = calloc(1, sizeof(SocketBuffers));
+        socket->buffers->highWatermark = SOCKET_HIGH_WATERMARK;
+    }
+    return socket->buffers;
+}
+
+// Return `count` buffered bytes in slot 0 and drop them from the receive buffer.
+static void takeSocketBytes(WrenVM *vm, SocketBuffers *buffers, size_t count) {
+    wrenSetSlotBytes(vm, 0, (const char*)&buffers->in.bytes[buffers->inStart], count);
+    buffers->inStart += count;
+    if (buffers->inScanned < buffers->inStart) buffers->inScanned = buffers->inStart;
+    if (buffers->inStart == buffers->in.count) {
+        buffers->in.count = buffers->inStart = buffers->inScanned = 0;
+    }
+}
+
+// Send as much of the send buffer as the socket will take. Returns the number of bytes still
+// queued, or -1 (setting errno) on failure.
+static ssize_t flushSocket(Socket *socket) {
+    SocketBuffers *buffers = socket->buffers;
+    while (buffers->outStart < buffers->out.count) {
+        ssize_t sent = send(socket->fd, &buffers->out.bytes[buffers->outStart],
+                buffers->out.count - buffers->outStart, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) break;
+            return -1;
+        }
+        buffers->outStart += sent;
+    }
+    if (buffers->outStart == buffers->out.count) buffers->out.count = buffers->outStart = 0;
+    return (ssize_t)(buffers->out.count - buffers->outStart);
+}
+
+// fill_() reads once from the socket into the receive buffer. Returns the number of bytes read,
+// 0 at the end of the stream, or null if none are available yet.
+void api_socket_fill_0(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    if (buffers->eof) {
+        wrenSetSlotDouble(vm, 0, 0);
+        return;
+    }
+    Buffer *in = &buffers->in;
+    if ((buffers->inStart > 0) && (buffers->inStart >= in->count / 2)) {
+        memmove(in->bytes, &in->bytes[buffers->inStart], in->count - buffers->inStart);
+        in->count -= buffers->inStart;
+        buffers->inScanned -= buffers->inStart;
+        buffers->inStart = 0;
+    }
+    if (in->capacity - in->count < SOCKET_READ_CHUNK) {
+        in->capacity = nextPowerOfTwo(in->count + SOCKET_READ_CHUNK);
+        in->bytes = realloc(in->bytes, in->capacity);
+    }
+    ssize_t count;
+    do {
+        count = read(socket->fd, &in->bytes[in->count], in->capacity - in->count);
+    } while ((count < 0) && (errno == EINTR));
+    if (count > 0) {
+        in->count += count;
+        wrenSetSlotDouble(vm, 0, (double)count);
+    } else if (count == 0) {
+        buffers->eof = true;
+        wrenSetSlotDouble(vm, 0, 0);
+    } else if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
+        wrenSetSlotNull(vm, 0);
+    } else {
+        abortErrno(vm, errno);
+    }
+}
+
+// take_(count) returns the next `count` received bytes, or null if fewer are buffered.
+void api_socket_take_1(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    size_t count = (size_t)wrenGetSlotDouble(vm, 1);
+    if (buffers->in.count - buffers->inStart < count) {
+        wrenSetSlotNull(vm, 0);
+        return;
+    }
+    takeSocketBytes(vm, buffers, count);
+}
+
+// takeUntil_(delimiter) returns the received bytes up to and including the first `delimiter`,
+// or null if it hasn't arrived. Bytes already searched aren't searched again.
+void api_socket_takeUntil_1(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    int delimiterLength;
+    const char *delimiter = wrenGetSlotBytes(vm, 1, &delimiterLength);
+    if (delimiterLength == 0) {
+        wrenSetSlotString(vm, 0, "The delimiter must not be empty.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    size_t from = buffers->inScanned;
+    if (from >= buffers->inStart + delimiterLength) from -= delimiterLength - 1;
+    else from = buffers->inStart;
+    const uint8_t *found = memmem(&buffers->in.bytes[from], buffers->in.count - from, delimiter,
+            delimiterLength);
+    if (!found) {
+        buffers->inScanned = buffers->in.count;
+        wrenSetSlotNull(vm, 0);
+        return;
+    }
+    takeSocketBytes(vm, buffers, (size_t)(found - &buffers->in.bytes[buffers->inStart]) +
+            delimiterLength);
+}
+
+// queue_(bytes) appends `bytes` to the send buffer; flush_() then sends what it can of it and
+// returns the number of bytes still queued.
+void api_socket_queue_1(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    int count;
+    const char *bytes = wrenGetSlotBytes(vm, 1, &count);
+    Buffer *out = &buffers->out;
+    if ((buffers->outStart > 0) && (buffers->outStart >= out->count / 2)) {
+        memmove(out->bytes, &out->bytes[buffers->outStart], out->count - buffers->outStart);
+        out->count -= buffers->outStart;
+        buffers->outStart = 0;
+    }
+    writeBuffer(out, (const uint8_t*)bytes, (size_t)count);
+    wrenSetSlotNull(vm, 0);
+}
+
+void api_socket_flush_0(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    getSocketBuffers(socket);
+    ssize_t remaining = flushSocket(socket);
+    if (remaining < 0) {
+        abortErrno(vm, errno);
+        return;
+    }
+    wrenSetSlotDouble(vm, 0, (double)remaining);
+}
+
+void api_socket_buffered_getter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = socket->buffers;
+    wrenSetSlotDouble(vm, 0, buffers ? (double)(buffers->in.count - buffers->inStart) : 0);
+}
+
+void api_socket_pending_getter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    SocketBuffers *buffers = socket->buffers;
+    wrenSetSlotDouble(vm, 0, buffers ? (double)(buffers->out.count - buffers->outStart) : 0);
+}
+
+void api_socket_highWatermark_getter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, (double)getSocketBuffers(socket)->highWatermark);
+}
+
+void api_socket_highWatermark_setter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    double value = wrenGetSlotDouble(vm, 1);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    if ((value < 1) || (value < (double)buffers->lowWatermark)) {
+        wrenSetSlotString(vm, 0, "The high watermark must be positive and at least the low one.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    buffers->highWatermark = (size_t)value;
+    wrenSetSlotNull(vm, 0);
+}
+
+void api_socket_lowWatermark_getter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, (double)getSocketBuffers(socket)->lowWatermark);
+}
+
+void api_socket_lowWatermark_setter(WrenVM *vm) {
+    Socket *socket = wrenGetSlotForeign(vm, 0);
+    double value = wrenGetSlotDouble(vm, 1);
+    SocketBuffers *buffers = getSocketBuffers(socket);
+    if ((value < 0) || (value > (double)buffers->highWatermark)) {
+        wrenSetSlotString(vm, 0, "The low watermark must be between 0 and the high one.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    buffers->lowWatermark = (size_t)value;
+    wrenSetSlotNull(vm, 0);
+}
+
 void apiStatic_Deque_fastCopy_4(WrenVM *vm) {
     // list, destStart, sourceStart, count
     // Moves count items from [sourceStart...sourceStart+count] to [destStart...destStart+count].
-    // The items are assumed to be non-overlapping.
-    size_t dest = (size_t)wrenGetSlotDouble(vm, 2);
-    size_t src = (size_t)wrenGetSlotDouble(vm, 3);
-    size_t count = (size_t)wrenGetSlotDouble(vm, 4);
-    for (size_t i = 0; i < count; i ++) {
-        wrenGetListElement(vm, 1, src + i, 4);
-        wrenSetListElement(vm, 1, dest + i, 4);
+    double args[3];
+    ggGetSlotDoubles(vm, 2, 3, args);
+    for (int i = 0; i < 3; i ++) {
+        // Also rejects NaN, and keeps the casts below defined.
+        if (!((args[i] >= 0) && (args[i] <= INT32_MAX) && (args[i] == (int)args[i]))) {
+            wrenSetSlotString(vm, 0, "Deque.fastCopy_ arguments must be non-negative integers.");
+            wrenAbortFiber(vm, 0);
+            return;
+        }
+    }
+    if (!ggMoveListRange(vm, 1, (int)args[0], (int)args[1], (int)args[2])) {
+        wrenSetSlotString(vm, 0, "Deque.fastCopy_ range is out of bounds.");
+        wrenAbortFiber(vm, 0);
+        return;
     }
     wrenSetSlotNull(vm, 0);
 }
@@ -930,6 +1346,7 @@ void apiStatic_Deque_fastCopy_4(WrenVM *vm) {
 void apiStatic_Term_prompt_0(WrenVM* vm) {
     char* result = NULL;
     size_t n = 0;
+    flushOutput();
     ssize_t length = getline(&result, &n, stdin);
     if (length < 0) {
         abortErrno(vm, errno);
@@ -941,10 +1358,115 @@ void apiStatic_Term_prompt_0(WrenVM* vm) {
     free(result);
 }
 
+#define POLL_MAX_EVENTS 256
+
+// Event bits (see std.io.poll).
+#define POLL_READ_READY  0x01
+#define POLL_WRITE_READY 0x02
+#define POLL_ERROR       0x04
+#define POLL_HUNG_UP     0x08
+#define POLL_NOT_OPEN    0x10
+#define POLL_EDGE        0x20
+#define POLL_ONE_SHOT    0x40
+
+// The token of the timerfd epollWaitSeconds(..) adds to a set. Tokens from Wren are integers that
+// fit in a double, so they never collide with it.
+#define TIMER_TOKEN UINT64_MAX
+
+// Timeouts are clamped to this many seconds, which keeps them in range of every clock type.
+#define MAX_TIMEOUT 1e9
+
+// Set once epoll_pwait2(..) has failed with ENOSYS; from then on we go straight to the timerfd.
+static bool noEpollPwait2;
+
+static struct timespec secondsToTimespec(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    if (ts.tv_nsec > 999999999) ts.tv_nsec = 999999999;
+    return ts;
+}
+
+static int waitWithTimerFd(int epollFd, int *timerFd, struct epoll_event *events, int maxEvents,
+        double timeout) {
+    if (*timerFd < 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) return -1;
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.u64 = TIMER_TOKEN;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            int e = errno;
+            (void)close(fd);
+            errno = e;
+            return -1;
+        }
+        *timerFd = fd;
+    }
+    struct itimerspec spec = {0};
+    spec.it_value = secondsToTimespec(timeout);
+    if (timerfd_settime(*timerFd, 0, &spec, NULL) < 0) return -1;
+    int count = epoll_wait(epollFd, events, maxEvents, -1);
+    int e = errno;
+    // Disarm and drain the timer whether or not it fired, so it can't end a later wait early.
+    memset(&spec, 0, sizeof(spec));
+    (void)timerfd_settime(*timerFd, 0, &spec, NULL);
+    uint64_t expirations;
+    (void)read(*timerFd, &expirations, sizeof(expirations));
+    errno = e;
+    return count;
+}
+
+// Wait on `epollFd` for up to `timeout` seconds (forever if negative), like epoll_wait(..) but
+// without rounding the timeout to whole milliseconds. `*timerFd` must start out as -1 and be
+// closed by the caller along with `epollFd`. Returns the number of events written to `events`,
+// which is 0 if the wait was interrupted by a signal, or -1 (setting errno) on failure.
+static int epollWaitSeconds(int epollFd, int *timerFd, struct epoll_event *events, int maxEvents,
+        double timeout) {
+    int count;
+    if (timeout > MAX_TIMEOUT) timeout = MAX_TIMEOUT;
+    double milliseconds = timeout * 1000.0;
+    if ((timeout < 0) || ((milliseconds == floor(milliseconds)) && (milliseconds <= INT_MAX))) {
+        count = epoll_wait(epollFd, events, maxEvents, (timeout < 0) ? -1 : (int)milliseconds);
+    } else {
+        count = -1;
+        errno = ENOSYS;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+        if (!noEpollPwait2) {
+            struct timespec ts = secondsToTimespec(timeout);
+            count = epoll_pwait2(epollFd, events, maxEvents, &ts, NULL);
+        }
+#endif
+        if ((count < 0) && (errno == ENOSYS)) {
+            noEpollPwait2 = true;
+            count = waitWithTimerFd(epollFd, timerFd, events, maxEvents, timeout);
+        }
+    }
+    if (count < 0) return (errno == EINTR) ? 0 : -1;
+    // Drop the timerfd's own event, if it's in the set and fired.
+    int kept = 0;
+    for (int i = 0; i < count; i ++) {
+        if (events[i].data.u64 != TIMER_TOKEN) events[kept ++] = events[i];
+    }
+    return kept;
+}
+
+// The epoll set behind add(..)/modify(..)/remove(..)/waitSeconds(..), created on first use so that
+// Polls used only for poll(..) don't hold an extra fd.
+typedef struct PollSet PollSet;
+struct PollSet {
+    int epollFd;
+    int timerFd;        // See epollWaitSeconds(..).
+    struct epoll_event events[POLL_MAX_EVENTS];
+    double ready[2 * POLL_MAX_EVENTS];   // Flattened (token, events) pairs for waitSeconds(..).
+};
+
 typedef struct Poll Poll;
 struct Poll {
     struct pollfd *fds;
+    double *values;     // Scratch space for moving the FD and event lists in and out.
     nfds_t nfds;
+    PollSet *set;
 };
 
 void apiAllocate_Poll(WrenVM* vm) {
@@ -955,6 +1477,12 @@ void apiAllocate_Poll(WrenVM* vm) {
 void apiFinalize_Poll(void* data) {
     Poll* poll = data;
     if (poll->fds) free(poll->fds);
+    if (poll->values) free(poll->values);
+    if (poll->set) {
+        (void)close(poll->set->epollFd);
+        if (poll->set->timerFd >= 0) (void)close(poll->set->timerFd);
+        free(poll->set);
+    }
 }
 
 void api_Poll_poll_3(WrenVM* vm) {
@@ -970,16 +1498,25 @@ void api_Poll_poll_3(WrenVM* vm) {
     if (pollObj->nfds < fdCount) {
         pollObj->nfds = nextPowerOfTwo(fdCount);
         pollObj->fds = realloc(pollObj->fds, sizeof(struct pollfd) * pollObj->nfds);
+        pollObj->values = realloc(pollObj->values, sizeof(double) * pollObj->nfds);
+    }
+    double *values = pollObj->values;
+    if (!ggGetListNums(vm, 1, 0, fdCount, values)) {
+        wrenSetSlotString(vm, 0, "The FD list must contain only numbers.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    for (size_t i = 0; i < fdCount; i ++) pollObj->fds[i].fd = (int)values[i];
+    if (!ggGetListNums(vm, 2, 0, fdCount, values)) {
+        wrenSetSlotString(vm, 0, "The event list must contain only numbers.");
+        wrenAbortFiber(vm, 0);
+        return;
     }
     for (size_t i = 0; i < fdCount; i ++) {
-        wrenGetListElement(vm, 1, i, 3);
-        int fd = (int)wrenGetSlotDouble(vm, 3);
-        pollObj->fds[i].fd = fd;
-        wrenGetListElement(vm, 2, i, 3);
-        int requestedEvents = (int)wrenGetSlotDouble(vm, 3);
+        int requestedEvents = (int)values[i];
         short events = 0;
-        if (requestedEvents & 0x1) events |= POLLIN;
-        if (requestedEvents & 0x2) events |= POLLOUT;
+        if (requestedEvents & POLL_READ_READY) events |= POLLIN;
+        if (requestedEvents & POLL_WRITE_READY) events |= POLLOUT;
         pollObj->fds[i].events = events;
         pollObj->fds[i].revents = 0;
     }
@@ -990,23 +1527,136 @@ void api_Poll_poll_3(WrenVM* vm) {
         for (size_t i = 0; i < fdCount; i ++) {
             short revents = pollObj->fds[i].revents;
             int returnedEvents = 0;
-            if (revents & POLLIN) returnedEvents |= 0x01;
-            if (revents & POLLOUT) returnedEvents |= 0x02;
-            if (revents & POLLERR) returnedEvents |= 0x04;
-            if (revents & POLLHUP) returnedEvents |= 0x08;
-            if (revents & POLLNVAL) returnedEvents |= 0x10;
-            wrenSetSlotDouble(vm, 3, (double)(returnedEvents));
-            wrenSetListElement(vm, 2, i, 3);
+            if (revents & POLLIN) returnedEvents |= POLL_READ_READY;
+            if (revents & POLLOUT) returnedEvents |= POLL_WRITE_READY;
+            if (revents & POLLERR) returnedEvents |= POLL_ERROR;
+            if (revents & POLLHUP) returnedEvents |= POLL_HUNG_UP;
+            if (revents & POLLNVAL) returnedEvents |= POLL_NOT_OPEN;
+            values[i] = (double)(returnedEvents);
             if (returnedEvents) {
                 trueResult ++;
             }
         }
+        ggSetListNums(vm, 2, 0, fdCount, values);
         wrenSetSlotDouble(vm, 0, (double)(trueResult));
     } else {
         abortErrno(vm, errno);
     }
 }
 
+static PollSet *getPollSet(WrenVM *vm, Poll *poll) {
+    if (poll->set) return poll->set;
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        abortErrno(vm, errno);
+        return NULL;
+    }
+    poll->set = malloc(sizeof(PollSet));
+    poll->set->epollFd = epollFd;
+    poll->set->timerFd = -1;
+    return poll->set;
+}
+
+// add(fd, events, token) and modify(fd, events, token) register `fd` for `events`, reported by
+// waitSeconds(..) with `token`. Registrations are level-triggered unless `events` includes
+// Poll.EDGE; with Poll.ONE_SHOT an fd reports once and then stays quiet until it is modified.
+// Closing an fd drops it from the set, so modify(..) adds an fd it doesn't find; that way a
+// caller re-arming an fd needn't know whether it was closed (and its number reused) meanwhile.
+static void pollControl(WrenVM *vm, int op) {
+    Poll *poll = wrenGetSlotForeign(vm, 0);
+    int fd = (int)wrenGetSlotDouble(vm, 1);
+    int requested = (int)wrenGetSlotDouble(vm, 2);
+    double token = wrenGetSlotDouble(vm, 3);
+    if ((token < 0) || (token > 9007199254740992.0) || (token != (double)(uint64_t)token)) {
+        wrenSetSlotString(vm, 0, "The token must be a non-negative integer.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    PollSet *set = getPollSet(vm, poll);
+    if (!set) return;
+    struct epoll_event event = {0};
+    if (requested & POLL_READ_READY) event.events |= EPOLLIN;
+    if (requested & POLL_WRITE_READY) event.events |= EPOLLOUT;
+    if (requested & POLL_EDGE) event.events |= EPOLLET;
+    if (requested & POLL_ONE_SHOT) event.events |= EPOLLONESHOT;
+    event.data.u64 = (uint64_t)token;
+    int result = epoll_ctl(set->epollFd, op, fd, &event);
+    if ((result < 0) && (op == EPOLL_CTL_MOD) && (errno == ENOENT)) {
+        result = epoll_ctl(set->epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+    if (result < 0) {
+        abortErrno(vm, errno);
+        return;
+    }
+    wrenSetSlotNull(vm, 0);
+}
+
+void api_Poll_add_3(WrenVM *vm) {
+    pollControl(vm, EPOLL_CTL_ADD);
+}
+
+void api_Poll_modify_3(WrenVM *vm) {
+    pollControl(vm, EPOLL_CTL_MOD);
+}
+
+// remove(fd) returns false if `fd` wasn't registered, which includes fds that have been closed
+// since (closing an fd drops it from the set).
+void api_Poll_remove_1(WrenVM *vm) {
+    Poll *poll = wrenGetSlotForeign(vm, 0);
+    int fd = (int)wrenGetSlotDouble(vm, 1);
+    if (!poll->set) {
+        wrenSetSlotBool(vm, 0, false);
+        return;
+    }
+    if (epoll_ctl(poll->set->epollFd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+        if ((errno != ENOENT) && (errno != EBADF)) {
+            abortErrno(vm, errno);
+            return;
+        }
+        wrenSetSlotBool(vm, 0, false);
+        return;
+    }
+    wrenSetSlotBool(vm, 0, true);
+}
+
+// waitSeconds(timeout, ready) blocks for up to `timeout` seconds (forever if negative) and writes
+// [token, events, token, events, ..] for the registered fds that are ready to the start of
+// `ready`, which must hold at least 2 * Poll.MAX_EVENTS elements, and returns how many fds that
+// was. Only the ready fds cross into Wren, however many are watched, and the list is reused.
+void api_Poll_waitSeconds_2(WrenVM *vm) {
+    Poll *poll = wrenGetSlotForeign(vm, 0);
+    double timeout = wrenGetSlotDouble(vm, 1);
+    if (wrenGetListCount(vm, 2) < 2 * POLL_MAX_EVENTS) {
+        wrenSetSlotString(vm, 0, "The ready list must hold at least 2 * Poll.MAX_EVENTS elements.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    PollSet *set = getPollSet(vm, poll);
+    if (!set) return;
+    int count = epollWaitSeconds(set->epollFd, &set->timerFd, set->events, POLL_MAX_EVENTS,
+            timeout);
+    if (count < 0) {
+        abortErrno(vm, errno);
+        return;
+    }
+    for (int i = 0; i < count; i ++) {
+        uint32_t revents = set->events[i].events;
+        int returnedEvents = 0;
+        if (revents & EPOLLIN) returnedEvents |= POLL_READ_READY;
+        if (revents & EPOLLOUT) returnedEvents |= POLL_WRITE_READY;
+        if (revents & EPOLLERR) returnedEvents |= POLL_ERROR;
+        if (revents & EPOLLHUP) returnedEvents |= POLL_HUNG_UP;
+        set->ready[2 * i] = (double)set->events[i].data.u64;
+        set->ready[2 * i + 1] = (double)returnedEvents;
+    }
+    ggSetListNums(vm, 2, 0, 2 * count, set->ready);
+    wrenSetSlotDouble(vm, 0, count);
+}
+
+void apiStatic_Poll_MAX_EVENTS_getter(WrenVM *vm) {
+    wrenSetSlotDouble(vm, 0, POLL_MAX_EVENTS);
+}
+
 typedef struct U32Array U32Array;
 struct U32Array {
     size_t count;
@@ -1117,6 +1767,8 @@ void initBuiltins(void) {
     ggRegisterMethod("Process", "static arguments", &apiStatic_Process_arguments_getter);
     ggRegisterMethod("Process", "static exit(_)", &apiStatic_Process_exit_1);
     ggRegisterMethod("Process", "static system(_)", &apiStatic_Process_system_1);
+    ggRegisterMethod("Process", "static workerCount", &apiStatic_Process_workerCount_getter);
+    ggRegisterMethod("Process", "static fork(_,_)", &apiStatic_Process_fork_2);
 
 
     ggRegisterClass("File", &apiAllocate_File, &apiFinalize_File);
@@ -1161,6 +1813,17 @@ void initBuiltins(void) {
     ggRegisterMethod("TcpStream", "write(_)", &api_socket_write_1);
     ggRegisterMethod("TcpStream", "isOpen", &api_socket_isOpen_getter);
     ggRegisterMethod("TcpStream", "fd", &api_socket_fd_getter);
+    ggRegisterMethod("TcpStream", "fill_()", &api_socket_fill_0);
+    ggRegisterMethod("TcpStream", "take_(_)", &api_socket_take_1);
+    ggRegisterMethod("TcpStream", "takeUntil_(_)", &api_socket_takeUntil_1);
+    ggRegisterMethod("TcpStream", "queue_(_)", &api_socket_queue_1);
+    ggRegisterMethod("TcpStream", "flush_()", &api_socket_flush_0);
+    ggRegisterMethod("TcpStream", "buffered", &api_socket_buffered_getter);
+    ggRegisterMethod("TcpStream", "pending", &api_socket_pending_getter);
+    ggRegisterMethod("TcpStream", "highWatermark", &api_socket_highWatermark_getter);
+    ggRegisterMethod("TcpStream", "highWatermark=(_)", &api_socket_highWatermark_setter);
+    ggRegisterMethod("TcpStream", "lowWatermark", &api_socket_lowWatermark_getter);
+    ggRegisterMethod("TcpStream", "lowWatermark=(_)", &api_socket_lowWatermark_setter);
 
     ggRegisterMethod("TcpStream", "peerAddress", &api_TcpStream_peerAddress_getter);
     ggRegisterMethod("TcpStream", "peerPort", &api_TcpStream_peerPort_getter);
@@ -1175,6 +1838,7 @@ void initBuiltins(void) {
     ggRegisterClass("UnixStream", &apiAllocate_UnixStream, &apiFinalize_socket);
     ggRegisterMethod("UnixStream", "static connect(_,_)", &apiStatic_UnixStream_connect_1);
     ggRegisterMethod("UnixStream", "static acceptFrom_(_)", &apiStatic_socket_acceptFrom_1);
+    ggRegisterMethod("UnixStream", "static pair()", &apiStatic_UnixStream_pair_0);
 
     ggRegisterMethod("UnixStream", "blocking", &api_socket_blocking_getter);
     ggRegisterMethod("UnixStream", "blocking=(_)", &api_socket_blocking_setter);
@@ -1183,10 +1847,26 @@ void initBuiltins(void) {
     ggRegisterMethod("UnixStream", "write(_)", &api_socket_write_1);
     ggRegisterMethod("UnixStream", "isOpen", &api_socket_isOpen_getter);
     ggRegisterMethod("UnixStream", "fd", &api_socket_fd_getter);
+    ggRegisterMethod("UnixStream", "fill_()", &api_socket_fill_0);
+    ggRegisterMethod("UnixStream", "take_(_)", &api_socket_take_1);
+    ggRegisterMethod("UnixStream", "takeUntil_(_)", &api_socket_takeUntil_1);
+    ggRegisterMethod("UnixStream", "queue_(_)", &api_socket_queue_1);
+    ggRegisterMethod("UnixStream", "flush_()", &api_socket_flush_0);
+    ggRegisterMethod("UnixStream", "buffered", &api_socket_buffered_getter);
+    ggRegisterMethod("UnixStream", "pending", &api_socket_pending_getter);
+    ggRegisterMethod("UnixStream", "highWatermark", &api_socket_highWatermark_getter);
+    ggRegisterMethod("UnixStream", "highWatermark=(_)", &api_socket_highWatermark_setter);
+    ggRegisterMethod("UnixStream", "lowWatermark", &api_socket_lowWatermark_getter);
+    ggRegisterMethod("UnixStream", "lowWatermark=(_)", &api_socket_lowWatermark_setter);
 
 
     ggRegisterClass("Poll", &apiAllocate_Poll, &apiFinalize_Poll);
     ggRegisterMethod("Poll", "poll(_,_,_)", &api_Poll_poll_3);
+    ggRegisterMethod("Poll", "static MAX_EVENTS", &apiStatic_Poll_MAX_EVENTS_getter);
+    ggRegisterMethod("Poll", "add(_,_,_)", &api_Poll_add_3);
+    ggRegisterMethod("Poll", "modify(_,_,_)", &api_Poll_modify_3);
+    ggRegisterMethod("Poll", "remove(_)", &api_Poll_remove_1);
+    ggRegisterMethod("Poll", "waitSeconds(_,_)", &api_Poll_waitSeconds_2);
 
     ggRegisterMethod("Deque", "static fastCopy_(_,_,_,_)", &apiStatic_Deque_fastCopy_4);
     ggRegisterMethod("Term", "static prompt()", &apiStatic_Term_prompt_0);
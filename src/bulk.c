@@ -0,0 +1,198 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// Bulk list, map and slot access for foreign methods, exported to extensions through GG_ABI.
+// Each of these replaces a loop of per-element API calls (and, for extensions, per-element calls
+// through the ABI table). With GG_WREN_INTERNALS they work on the list's storage directly;
+// otherwise they fall back to the public API using one scratch slot past the current ones.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+#ifdef GG_WREN_INTERNALS
+#include <wren_vm.h>
+#endif
+
+#include "gg.h"
+
+// Private to wren_value.c, so repeated here.
+#define MAP_LOAD_PERCENT 75
+#define MAP_MIN_CAPACITY 16
+
+#ifndef GG_WREN_INTERNALS
+static int scratchSlot(WrenVM *vm) {
+    int slot = wrenGetSlotCount(vm);
+    wrenEnsureSlots(vm, slot + 1);
+    return slot;
+}
+#endif
+
+static int listCount(WrenVM *vm, int list) {
+#ifdef GG_WREN_INTERNALS
+    return AS_LIST(vm->apiStack[list])->elements.count;
+#else
+    return wrenGetListCount(vm, list);
+#endif
+}
+
+// Whether [start, start + count) lies within a list of `size` elements.
+static bool rangeInList(int size, int start, int count) {
+    return (start >= 0) && (count >= 0) && (start <= size - count);
+}
+
+// Read elements [start, start + count) of the list in `list` into `nums`. Returns false (leaving
+// `nums` partly written) if the range isn't within the list or any element is not a Num.
+bool ggGetListNums(WrenVM *vm, int list, int start, int count, double *nums) {
+    if (!rangeInList(listCount(vm, list), start, count)) return false;
+#ifdef GG_WREN_INTERNALS
+    Value *elements = &AS_LIST(vm->apiStack[list])->elements.data[start];
+    for (int i = 0; i < count; i ++) {
+        if (!IS_NUM(elements[i])) return false;
+        nums[i] = AS_NUM(elements[i]);
+    }
+#else
+    int scratch = scratchSlot(vm);
+    for (int i = 0; i < count; i ++) {
+        wrenGetListElement(vm, list, start + i, scratch);
+        if (wrenGetSlotType(vm, scratch) != WREN_TYPE_NUM) return false;
+        nums[i] = wrenGetSlotDouble(vm, scratch);
+    }
+#endif
+    return true;
+}
+
+// Store `nums` as elements [start, start + count) of the list in `list`, appending to it where
+// the range runs past its end. Returns false (changing nothing) if `start` is past the end.
+bool ggSetListNums(WrenVM *vm, int list, int start, int count, const double *nums) {
+    if ((start < 0) || (count < 0) || (start > listCount(vm, list))) return false;
+#ifdef GG_WREN_INTERNALS
+    ObjList *obj = AS_LIST(vm->apiStack[list]);
+    int overwritten = obj->elements.count - start;
+    if (overwritten > count) overwritten = count;
+    for (int i = 0; i < overwritten; i ++) {
+        obj->elements.data[start + i] = NUM_VAL(nums[i]);
+    }
+    for (int i = overwritten; i < count; i ++) {
+        wrenValueBufferWrite(vm, &obj->elements, NUM_VAL(nums[i]));
+    }
+#else
+    int scratch = scratchSlot(vm);
+    int overwritten = wrenGetListCount(vm, list) - start;
+    if (overwritten > count) overwritten = count;
+    for (int i = 0; i < count; i ++) {
+        wrenSetSlotDouble(vm, scratch, nums[i]);
+        if (i < overwritten) wrenSetListElement(vm, list, start + i, scratch);
+        else wrenInsertInList(vm, list, -1, scratch);
+    }
+#endif
+    return true;
+}
+
+// Copy elements [src, src + count) of the list in `list` to [dest, dest + count), like memmove(..);
+// the ranges may overlap. Returns false (changing nothing) if either isn't within the list.
+bool ggMoveListRange(WrenVM *vm, int list, int dest, int src, int count) {
+    int size = listCount(vm, list);
+    if (!rangeInList(size, src, count) || !rangeInList(size, dest, count)) return false;
+    if ((dest == src) || (count == 0)) return true;
+#ifdef GG_WREN_INTERNALS
+    Value *elements = AS_LIST(vm->apiStack[list])->elements.data;
+    memmove(&elements[dest], &elements[src], count * sizeof(Value));
+#else
+    int scratch = scratchSlot(vm);
+    if (dest < src) {
+        for (int i = 0; i < count; i ++) {
+            wrenGetListElement(vm, list, src + i, scratch);
+            wrenSetListElement(vm, list, dest + i, scratch);
+        }
+    } else {
+        for (int i = count - 1; i >= 0; i --) {
+            wrenGetListElement(vm, list, src + i, scratch);
+            wrenSetListElement(vm, list, dest + i, scratch);
+        }
+    }
+#endif
+    return true;
+}
+
+// Put a new list of `count` nulls in `slot`.
+void ggSetSlotNewListSized(WrenVM *vm, int slot, int count) {
+#ifdef GG_WREN_INTERNALS
+    ObjList *obj = wrenNewList(vm, count);
+    for (int i = 0; i < count; i ++) obj->elements.data[i] = NULL_VAL;
+    vm->apiStack[slot] = OBJ_VAL(obj);
+#else
+    wrenSetSlotNewList(vm, slot);
+    int scratch = scratchSlot(vm);
+    wrenSetSlotNull(vm, scratch);
+    for (int i = 0; i < count; i ++) wrenInsertInList(vm, slot, -1, scratch);
+#endif
+}
+
+// Put a new, empty map with room for `count` entries in `slot`. Without GG_WREN_INTERNALS the
+// size is only a hint and the map grows as usual.
+void ggSetSlotNewMapSized(WrenVM *vm, int slot, int count) {
+#ifdef GG_WREN_INTERNALS
+    ObjMap *map = wrenNewMap(vm);
+    vm->apiStack[slot] = OBJ_VAL(map);
+    // Mirror resizeMap(..) in wren_value.c, so the first `count` insertions never resize.
+    uint32_t capacity = (uint32_t)count * 100 / MAP_LOAD_PERCENT + 1;
+    if (count > 0) {
+        if (capacity < MAP_MIN_CAPACITY) capacity = MAP_MIN_CAPACITY;
+        map->entries = ALLOCATE_ARRAY(vm, MapEntry, capacity);
+        for (uint32_t i = 0; i < capacity; i ++) {
+            map->entries[i].key = UNDEFINED_VAL;
+            map->entries[i].value = FALSE_VAL;
+        }
+        map->capacity = capacity;
+    }
+#else
+    (void)count;
+    wrenSetSlotNewMap(vm, slot);
+#endif
+}
+
+// Read the Nums in slots [first, first + count).
+void ggGetSlotDoubles(WrenVM *vm, int first, int count, double *nums) {
+#ifdef GG_WREN_INTERNALS
+    for (int i = 0; i < count; i ++) nums[i] = AS_NUM(vm->apiStack[first + i]);
+#else
+    for (int i = 0; i < count; i ++) nums[i] = wrenGetSlotDouble(vm, first + i);
+#endif
+}
+
+// Store `nums` in slots [first, first + count).
+void ggSetSlotDoubles(WrenVM *vm, int first, int count, const double *nums) {
+#ifdef GG_WREN_INTERNALS
+    for (int i = 0; i < count; i ++) vm->apiStack[first + i] = NUM_VAL(nums[i]);
+#else
+    for (int i = 0; i < count; i ++) wrenSetSlotDouble(vm, first + i, nums[i]);
+#endif
+}
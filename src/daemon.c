@@ -0,0 +1,347 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// `-daemon=<socket>` and `-client`. The daemon imports the standard library once, then keeps a
+// few forked workers blocked in accept(..) on a Unix socket, each holding a copy of the warm VM.
+// A client connects and sends its stdin/stdout/stderr (as SCM_RIGHTS), working directory,
+// arguments and environment; one worker adopts them, runs the script and reports the exit code
+// back before exiting, and the daemon forks a replacement.
+//
+// Request: a DaemonRequest header (sent with the three fds) followed by `size` bytes holding the
+// working directory, the `argc` arguments and the `envc` environment entries, each terminated
+// by a NUL. Reply: the exit code as an int32_t. A client that reads EOF instead knows the worker
+// died without exiting.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+// Platform-specific includes
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#include "gg.h"
+
+#define DAEMON_MAGIC 0x44444747 /* "GGDD" */
+#define DAEMON_MAX_REQUEST (16 * 1024 * 1024)
+
+extern char **environ;
+
+typedef struct DaemonRequest DaemonRequest;
+struct DaemonRequest {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t size;
+};
+
+static int daemonClient = -1;
+static pid_t daemonWorker = 0;
+static volatile sig_atomic_t daemonStopSignal = 0;
+
+/**************************************************************************************************/
+
+static bool writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t count = write(fd, bytes, size);
+        if ((count < 0) && (errno == EINTR)) continue;
+        if (count <= 0) return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size > 0) {
+        ssize_t count = read(fd, bytes, size);
+        if ((count < 0) && (errno == EINTR)) continue;
+        if (count <= 0) return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+static bool daemonAddress(const char *socketPath, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m The socket path `%s` is too long.\n", socketPath);
+        return false;
+    }
+    strcpy(address->sun_path, socketPath);
+    return true;
+}
+
+/**************************************************************************************************/
+
+// Registered with on_exit(..) in a worker, so that the client gets the code however the script
+// ends (including Process.exit(..)).
+static void reportExitCode(int status, void *unused) {
+    (void)unused;
+    // Children the script forks (Process.fork) inherit this handler; only the worker reports.
+    if ((daemonClient < 0) || (getpid() != daemonWorker)) return;
+    flushOutput();
+    fflush(stdout);
+    fflush(stderr);
+    int32_t code = status;
+    (void)writeAll(daemonClient, &code, sizeof(code));
+    (void)close(daemonClient);
+    daemonClient = -1;
+}
+
+// Take one request and turn this process into the client's: its stdio, working directory and
+// environment. Returns false (and the worker just exits) if the request is malformed.
+static bool adoptClient(int client, char ***argvOut, int *argcOut) {
+    DaemonRequest request;
+    int fds[3] = { -1, -1, -1 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { .iov_base = &request, .iov_len = sizeof(request) };
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t count;
+    do {
+        count = recvmsg(client, &message, MSG_CMSG_CLOEXEC);
+    } while ((count < 0) && (errno == EINTR));
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header && (header->cmsg_level == SOL_SOCKET) && (header->cmsg_type == SCM_RIGHTS) &&
+        (header->cmsg_len == CMSG_LEN(sizeof(fds))))
+    {
+        memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    }
+    bool ok = (count > 0) && (fds[2] >= 0);
+    if (ok && (count < sizeof(request))) {
+        ok = readAll(client, &((char*)&request)[count], sizeof(request) - count);
+    }
+    ok = ok && (request.magic == DAEMON_MAGIC) && (request.size <= DAEMON_MAX_REQUEST);
+    // Every string takes at least its terminator, so the cwd, arguments and environment can't
+    // outnumber the bytes; checking here also keeps `total` below from wrapping.
+    ok = ok && (request.argc < request.size) && (request.envc < request.size - request.argc);
+    char *strings = ok ? malloc(request.size + 1) : NULL;
+    ok = ok && strings && readAll(client, strings, request.size);
+    char **argv = NULL;
+    char **envp = NULL;
+    if (ok) {
+        strings[request.size] = 0;
+        uint32_t total = 1 + request.argc + request.envc;
+        char **all = calloc(total + 2, sizeof(char*));
+        char *cursor = strings;
+        char *end = &strings[request.size];
+        if (!all) ok = false;
+        for (uint32_t i = 0; ok && (i < total); i ++) {
+            if (cursor >= end) ok = false;
+            all[i + (i > request.argc ? 1 : 0)] = cursor;
+            cursor += strlen(cursor) + 1;
+        }
+        // all = [cwd, args.., NULL, env.., NULL]
+        argv = &all[1];
+        envp = &all[2 + request.argc];
+        if (ok && (chdir(all[0]) < 0)) ok = false;
+    }
+    if (ok) {
+        for (int i = 0; i < 3; i ++) {
+            if (dup2(fds[i], i) < 0) ok = false;
+        }
+    }
+    for (int i = 0; i < 3; i ++) {
+        if (fds[i] > 2) (void)close(fds[i]);
+    }
+    if (!ok) return false;
+    environ = envp;
+    *argvOut = argv;
+    *argcOut = request.argc;
+    return true;
+}
+
+static void runWorker(int listener, DaemonRunFn run) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    int client;
+    do {
+        client = accept(listener, NULL, NULL);
+    } while ((client < 0) && (errno == EINTR));
+    (void)close(listener);
+    if (client < 0) _exit(1);
+    char **argv;
+    int argc;
+    if (!adoptClient(client, &argv, &argc)) _exit(1);
+    daemonClient = client;
+    daemonWorker = getpid();
+    on_exit(&reportExitCode, NULL);
+    exit(run(argc, argv));
+}
+
+static void handleDaemonStop(int signal) {
+    daemonStopSignal = signal;
+}
+
+int runDaemon(const char *socketPath, int workers, DaemonRunFn run) {
+    struct sockaddr_un address;
+    if (!daemonAddress(socketPath, &address)) return -1;
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m socket(..) failed: %s\n", strerror(errno));
+        return -1;
+    }
+    // Only this user may connect; the socket hands over stdio and runs code as us.
+    (void)unlink(socketPath);
+    mode_t oldMask = umask(0077);
+    bool ok = (bind(listener, (struct sockaddr*)&address, sizeof(address)) >= 0) &&
+            (listen(listener, 64) >= 0);
+    umask(oldMask);
+    if (!ok) {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m Could not listen on `%s`: %s\n", socketPath,
+                strerror(errno));
+        (void)close(listener);
+        return -1;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = &handleDaemonStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    int running = 0;
+    while (!daemonStopSignal) {
+        for (int i = 0; i < workers; i ++) {
+            if (pids[i] > 0) continue;
+            pid_t pid = fork();
+            if (pid == 0) runWorker(listener, run);
+            if (pid > 0) {
+                pids[i] = pid;
+                running ++;
+            }
+        }
+        if (running == 0) {
+            fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m Could not fork any daemon workers.\n");
+            break;
+        }
+        pid_t pid = waitpid(-1, NULL, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < workers; i ++) {
+            if (pids[i] == pid) {
+                pids[i] = 0;
+                running --;
+            }
+        }
+    }
+    for (int i = 0; i < workers; i ++) {
+        if (pids[i] > 0) (void)kill(pids[i], SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR);
+    free(pids);
+    (void)close(listener);
+    (void)unlink(socketPath);
+    return 0;
+}
+
+/**************************************************************************************************/
+
+int runClient(const char *socketPath, int argc, char **argv) {
+    struct sockaddr_un address;
+    if (!daemonAddress(socketPath, &address)) return -1;
+    int daemon = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((daemon < 0) || (connect(daemon, (struct sockaddr*)&address, sizeof(address)) < 0)) {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m Could not connect to the GGWren daemon at "
+                "`%s`: %s\n", socketPath, strerror(errno));
+        if (daemon >= 0) (void)close(daemon);
+        return -1;
+    }
+
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd) cwd = strdup("/");
+    DaemonRequest request = { DAEMON_MAGIC, (uint32_t)argc, 0, 0 };
+    size_t size = strlen(cwd) + 1;
+    for (int i = 0; i < argc; i ++) size += strlen(argv[i]) + 1;
+    for (char **env = environ; *env; env ++) {
+        size += strlen(*env) + 1;
+        request.envc ++;
+    }
+    request.size = size;
+    char *strings = malloc(size);
+    char *cursor = strings;
+    cursor = stpcpy(cursor, cwd) + 1;
+    for (int i = 0; i < argc; i ++) cursor = stpcpy(cursor, argv[i]) + 1;
+    for (char **env = environ; *env; env ++) cursor = stpcpy(cursor, *env) + 1;
+    free(cwd);
+
+    int fds[3] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = &request, .iov_len = sizeof(request) };
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(daemon, &message, MSG_NOSIGNAL);
+    } while ((sent < 0) && (errno == EINTR));
+    bool ok = (sent >= 0) && writeAll(daemon, &((char*)&request)[sent], sizeof(request) - sent) &&
+            writeAll(daemon, strings, size);
+    free(strings);
+    int32_t code = -1;
+    ok = ok && readAll(daemon, &code, sizeof(code));
+    (void)close(daemon);
+    if (!ok) {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m The GGWren daemon at `%s` did not report an "
+                "exit code.\n", socketPath);
+        return -1;
+    }
+    return code;
+}
@@ -1,10 +1,122 @@
+// Prefixes for messages on stderr.
+#define WARNING "\x1b[33;1m[WARNING]\x1b[m "
+#define ERROR   "\x1b[31;1m[ERROR]\x1b[m "
+#define TRACE   "\x1b[36m[TRACE]\x1b[m "
+#define NOTE    "\x1b[36m[NOTE]\x1b[m "
+
 extern char **scriptArgv;
 extern int scriptArgc;
+extern int workerCount;
 
 void ggRegisterClass(const char *name, WrenForeignMethodFn allocate, WrenFinalizerFn finalize);
 void ggRegisterMethod(const char *className, const char *signature, WrenForeignMethodFn fn);
 
 void initBuiltins(void); // Defined in builtins.c.
 
+// Defined in bulk.c; also exported to extensions through GG_ABI (see ggwren.h).
+bool ggGetListNums(WrenVM *vm, int list, int start, int count, double *nums);
+bool ggSetListNums(WrenVM *vm, int list, int start, int count, const double *nums);
+bool ggMoveListRange(WrenVM *vm, int list, int dest, int src, int count);
+void ggSetSlotNewListSized(WrenVM *vm, int slot, int count);
+void ggSetSlotNewMapSized(WrenVM *vm, int slot, int count);
+void ggGetSlotDoubles(WrenVM *vm, int first, int count, double *nums);
+void ggSetSlotDoubles(WrenVM *vm, int first, int count, const double *nums);
+
 static inline char *dupString(const char *string);
 size_t nextPowerOfTwo(size_t x);
+uint64_t monotonicNanoseconds(void);
+
+// Defined in alloc.c.
+#define ALLOCATOR_SIZE_CLASSES 17
+#define ALLOCATOR_LARGE ALLOCATOR_SIZE_CLASSES
+
+typedef enum AllocatorKind {
+    ALLOCATOR_SYSTEM,
+    ALLOCATOR_SLAB
+} AllocatorKind;
+
+typedef struct Allocator Allocator;
+struct Allocator {
+    AllocatorKind kind;
+    void *freeLists[ALLOCATOR_SIZE_CLASSES];
+    char *slabCursors[ALLOCATOR_SIZE_CLASSES];
+    char *slabEnds[ALLOCATOR_SIZE_CLASSES];
+    void *slabs;
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t reservedBytes;
+    uint64_t allocations;
+    uint64_t frees;
+    struct {
+        uint64_t live;
+        uint64_t liveBytes;
+        uint64_t allocations;
+    } classes[ALLOCATOR_SIZE_CLASSES + 1]; // The last entry counts large allocations.
+};
+
+void initAllocator(Allocator *allocator, AllocatorKind kind);
+void finishAllocator(Allocator *allocator);
+size_t allocatorClassSize(int sizeClass);
+void* ggReallocate(void *memory, size_t newSize, void *userData);
+
+// Defined in main.c. Each host VM gets its own module loader state, error buffer and allocator.
+WrenVM* newHostVM(void *isolate);
+void freeHostVM(WrenVM *vm);
+const char* hostError(WrenVM *vm);
+void* hostIsolate(WrenVM *vm);
+const Allocator* hostAllocator(WrenVM *vm);
+void hostGcStats(WrenVM *vm, int *collectionsOut, uint64_t *pauseNanosecondsOut);
+bool isValidModuleName(const char *name);
+
+// Defined in isolate.c.
+void initIsolates(void);
+void joinIsolates(void);
+
+void initTimers(void); // Defined in timers.c.
+
+// Defined in work.c. ggSubmitWork(..) is also exported to extensions (see ggwren.h).
+extern int workThreads;
+bool ggSubmitWork(WrenVM *vm, int job, void (*work)(void *data),
+        void (*complete)(WrenVM *vm, void *data), void *data);
+void initWork(void);
+void finishWork(void);
+
+// Defined in profile.c. startProfiler(..) samples `vm` `hz` times per second of CPU time and
+// writes folded stacks to `path` at exit; stopProfiler() must be called before `vm` is freed.
+bool startProfiler(WrenVM *vm, const char *path, int hz, const char **errorOut);
+void stopProfiler(void);
+
+// Defined in trace.c.
+WrenForeignMethodFn traceForeignMethod(const char *module, const char *name,
+        WrenForeignMethodFn fn);
+void apiStatic_GG_foreignStats_getter(WrenVM *vm);
+void dumpForeignStats(void);
+
+// Defined in daemon.c. runDaemon(..) serves -client requests on `socketPath` until SIGTERM or
+// SIGINT, calling `run` in a freshly forked worker for each one; runClient(..) returns the
+// script's exit code, or -1 if the daemon could not be reached.
+typedef int (*DaemonRunFn)(int argc, char **argv);
+int runDaemon(const char *socketPath, int workers, DaemonRunFn run);
+int runClient(const char *socketPath, int argc, char **argv);
+
+// Defined in output.c. All of Wren's stdout goes through writeOutput(..); see there for when the
+// buffer is written. Call flushOutput() before anything else writes to stdout or stderr.
+typedef enum {
+    OUTPUT_DEFAULT,
+    OUTPUT_LINE,
+    OUTPUT_FULL,
+    OUTPUT_INTERVAL
+} OutputPolicy;
+extern OutputPolicy outputPolicy;
+extern size_t outputBufferSize;
+extern int outputIntervalMs;
+void writeOutput(const char *text, size_t length);
+void flushOutput(void);
+void initOutput(void);
+void apiStatic_GG_flush_0(WrenVM *vm);
+
+// Defined in metrics.c. `metricsAddress` is the -metrics argument (null when not serving).
+extern char *metricsAddress;
+void apiStatic_GG_metricsAddress_getter(WrenVM *vm);
+void recordModuleLoad(const char *name, uint64_t nanoseconds);
+void initMetrics(void);
@@ -0,0 +1,496 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// Isolates: extra WrenVMs, each running on its own thread with its own host context, talking to
+// the VM that spawned them over a channel of strings. Nothing Wren-side is shared; a message is
+// copied into the channel on send and copied out again on receive.
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+// Platform-specific includes
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#include "gg.h"
+
+#define CHANNEL_PARENT 0
+#define CHANNEL_CHILD  1
+
+typedef struct Message Message;
+struct Message {
+    Message *next;
+    size_t size;
+    char bytes[];
+};
+
+// Messages waiting to be received by one side. `fd` is an eventfd that is readable whenever
+// the queue is non-empty or the sending side has gone away.
+typedef struct MessageQueue MessageQueue;
+struct MessageQueue {
+    Message *head;
+    Message *tail;
+    int fd;
+};
+
+// queues[side] holds the messages sent *to* `side`. A side stays open while anything still
+// holds a reference to it and it hasn't been closed explicitly. `pins` keep the channel itself
+// alive without holding either side open (see joinIsolates()).
+typedef struct ChannelShared ChannelShared;
+struct ChannelShared {
+    pthread_mutex_t lock;
+    MessageQueue queues[2];
+    int refs[2];
+    bool closed[2];
+    int pins;
+};
+
+// The payload of a Channel object: one end of a ChannelShared.
+typedef struct ChannelEnd ChannelEnd;
+struct ChannelEnd {
+    ChannelShared *shared;
+    int side;
+};
+
+// Every isolate thread stays in `liveIsolates` until it has been joined, so none is left running
+// when the host is torn down. `claimed` (under isolatesLock) is set by whichever thread is going
+// to join it; the rest wait for `joined`.
+typedef struct Isolate Isolate;
+struct Isolate {
+    pthread_t thread;
+    ChannelShared *channel;
+    char *source;
+    int refs;
+    bool done;
+    bool succeeded;
+    bool claimed;
+    bool joined;
+    Isolate *next;
+};
+
+static pthread_mutex_t isolatesLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t isolateJoined = PTHREAD_COND_INITIALIZER;
+static Isolate *liveIsolates = NULL;
+
+/**************************************************************************************************/
+
+static void signalQueue(MessageQueue *queue) {
+    uint64_t one = 1;
+    (void)write(queue->fd, &one, sizeof(one));
+}
+
+static void drainQueue(MessageQueue *queue) {
+    uint64_t count;
+    (void)read(queue->fd, &count, sizeof(count));
+}
+
+static ChannelShared* newChannel(void) {
+    ChannelShared *channel = calloc(1, sizeof(ChannelShared));
+    pthread_mutex_init(&channel->lock, NULL);
+    for (int side = 0; side < 2; side ++) {
+        channel->queues[side].fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (channel->queues[side].fd < 0) {
+            if (side == 1) (void)close(channel->queues[0].fd);
+            pthread_mutex_destroy(&channel->lock);
+            free(channel);
+            return NULL;
+        }
+    }
+    return channel;
+}
+
+static bool sideIsOpen(ChannelShared *channel, int side) {
+    return (channel->refs[side] > 0) && !channel->closed[side];
+}
+
+static void retainChannel(ChannelShared *channel, int side) {
+    pthread_mutex_lock(&channel->lock);
+    channel->refs[side] ++;
+    pthread_mutex_unlock(&channel->lock);
+}
+
+static void freeChannel(ChannelShared *channel) {
+    for (int i = 0; i < 2; i ++) {
+        Message *next;
+        for (Message *message = channel->queues[i].head; message; message = next) {
+            next = message->next;
+            free(message);
+        }
+        (void)close(channel->queues[i].fd);
+    }
+    pthread_mutex_destroy(&channel->lock);
+    free(channel);
+}
+
+static bool channelIsUnused(ChannelShared *channel) {
+    return (channel->refs[0] == 0) && (channel->refs[1] == 0) && (channel->pins == 0);
+}
+
+static void releaseChannel(ChannelShared *channel, int side) {
+    pthread_mutex_lock(&channel->lock);
+    bool wasOpen = sideIsOpen(channel, side);
+    channel->refs[side] --;
+    if (wasOpen && !sideIsOpen(channel, side)) signalQueue(&channel->queues[!side]);
+    bool unused = channelIsUnused(channel);
+    pthread_mutex_unlock(&channel->lock);
+    if (unused) freeChannel(channel);
+}
+
+static void unpinChannel(ChannelShared *channel) {
+    pthread_mutex_lock(&channel->lock);
+    channel->pins --;
+    bool unused = channelIsUnused(channel);
+    pthread_mutex_unlock(&channel->lock);
+    if (unused) freeChannel(channel);
+}
+
+static void releaseIsolate(Isolate *isolate) {
+    if (__atomic_sub_fetch(&isolate->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(isolate->source);
+        free(isolate);
+    }
+}
+
+// Join an isolate's thread once this thread has claimed it, and drop it from liveIsolates along
+// with the list's references.
+static void joinClaimedIsolate(Isolate *isolate) {
+    pthread_join(isolate->thread, NULL);
+    pthread_mutex_lock(&isolatesLock);
+    isolate->joined = true;
+    for (Isolate **link = &liveIsolates; *link; link = &(*link)->next) {
+        if (*link == isolate) {
+            *link = isolate->next;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&isolateJoined);
+    pthread_mutex_unlock(&isolatesLock);
+    unpinChannel(isolate->channel);
+    releaseIsolate(isolate);
+}
+
+// Join the isolates that have already finished, so that a script spawning many short-lived
+// ones doesn't accumulate threads.
+static void joinFinishedIsolates(void) {
+    while (true) {
+        Isolate *finished = NULL;
+        pthread_mutex_lock(&isolatesLock);
+        for (Isolate *isolate = liveIsolates; isolate; isolate = isolate->next) {
+            if (!isolate->claimed && __atomic_load_n(&isolate->done, __ATOMIC_ACQUIRE)) {
+                isolate->claimed = true;
+                finished = isolate;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&isolatesLock);
+        if (!finished) return;
+        joinClaimedIsolate(finished);
+    }
+}
+
+// Put a new Channel object for `side` of `channel` in slot 0. `classSlot` must hold the
+// Channel class.
+static void newChannelEnd(WrenVM *vm, int classSlot, ChannelShared *channel, int side) {
+    ChannelEnd *end = wrenSetSlotNewForeign(vm, 0, classSlot, sizeof(ChannelEnd));
+    end->shared = channel;
+    end->side = side;
+    retainChannel(channel, side);
+}
+
+/**************************************************************************************************/
+
+static void apiAllocate_Channel(WrenVM *vm) {
+    ChannelEnd *end = wrenSetSlotNewForeign(vm, 0, 0, sizeof(ChannelEnd));
+    end->shared = NULL;
+    wrenSetSlotString(vm, 0, "Channels are created by Isolate.spawn(..); use Isolate.channel "
+            "or Isolate.parent to get one.");
+    wrenAbortFiber(vm, 0);
+}
+
+static void apiFinalize_Channel(void *raw) {
+    ChannelEnd *end = raw;
+    if (end->shared) releaseChannel(end->shared, end->side);
+}
+
+static void apiStatic_Channel_parent_getter(WrenVM *vm) {
+    Isolate *isolate = hostIsolate(vm);
+    if (isolate) {
+        newChannelEnd(vm, 0, isolate->channel, CHANNEL_CHILD);
+    } else {
+        wrenSetSlotNull(vm, 0);
+    }
+}
+
+static void api_Channel_send_1(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    int count;
+    const char *bytes = wrenGetSlotBytes(vm, 1, &count);
+    ChannelShared *channel = end->shared;
+    MessageQueue *queue = &channel->queues[!end->side];
+    bool sent = false;
+    pthread_mutex_lock(&channel->lock);
+    if (sideIsOpen(channel, !end->side) && sideIsOpen(channel, end->side)) {
+        Message *message = malloc(sizeof(Message) + count);
+        message->next = NULL;
+        message->size = count;
+        memcpy(message->bytes, bytes, count);
+        if (queue->tail) {
+            queue->tail->next = message;
+        } else {
+            queue->head = message;
+            signalQueue(queue);
+        }
+        queue->tail = message;
+        sent = true;
+    }
+    pthread_mutex_unlock(&channel->lock);
+    wrenSetSlotBool(vm, 0, sent);
+}
+
+static void api_Channel_receive_0(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    ChannelShared *channel = end->shared;
+    MessageQueue *queue = &channel->queues[end->side];
+    pthread_mutex_lock(&channel->lock);
+    Message *message = queue->head;
+    if (message) {
+        queue->head = message->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+            // Leave the fd readable once the other side is gone, so waiters notice.
+            if (sideIsOpen(channel, !end->side)) drainQueue(queue);
+        }
+    }
+    pthread_mutex_unlock(&channel->lock);
+    if (message) {
+        wrenSetSlotBytes(vm, 0, message->bytes, message->size);
+        free(message);
+    } else {
+        wrenSetSlotNull(vm, 0);
+    }
+}
+
+static void api_Channel_wait_0(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    struct pollfd pfd = { .fd = end->shared->queues[end->side].fd, .events = POLLIN };
+    while ((poll(&pfd, 1, -1) < 0) && (errno == EINTR)) {}
+    wrenSetSlotNull(vm, 0);
+}
+
+static void api_Channel_fd_getter(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, end->shared->queues[end->side].fd);
+}
+
+static void api_Channel_isClosed_getter(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    ChannelShared *channel = end->shared;
+    pthread_mutex_lock(&channel->lock);
+    bool closed = !channel->queues[end->side].head &&
+            !(sideIsOpen(channel, 0) && sideIsOpen(channel, 1));
+    pthread_mutex_unlock(&channel->lock);
+    wrenSetSlotBool(vm, 0, closed);
+}
+
+static void api_Channel_close_0(WrenVM *vm) {
+    ChannelEnd *end = wrenGetSlotForeign(vm, 0);
+    ChannelShared *channel = end->shared;
+    pthread_mutex_lock(&channel->lock);
+    if (sideIsOpen(channel, end->side)) {
+        channel->closed[end->side] = true;
+        signalQueue(&channel->queues[!end->side]);
+    }
+    pthread_mutex_unlock(&channel->lock);
+    wrenSetSlotNull(vm, 0);
+}
+
+/**************************************************************************************************/
+
+static void* runIsolate(void *raw) {
+    Isolate *isolate = raw;
+    WrenVM *vm = newHostVM(isolate);
+    WrenInterpretResult result = wrenInterpret(vm, "<isolate>", isolate->source);
+    if (result != WREN_RESULT_SUCCESS) fprintf(stderr, "%s", hostError(vm));
+    freeHostVM(vm);
+    isolate->succeeded = (result == WREN_RESULT_SUCCESS);
+    __atomic_store_n(&isolate->done, true, __ATOMIC_RELEASE);
+    releaseChannel(isolate->channel, CHANNEL_CHILD);
+    releaseIsolate(isolate);
+    return NULL;
+}
+
+static bool isIdentifier(const char *text) {
+    if (!((*text == '_') || ((*text | 0x20) >= 'a' && (*text | 0x20) <= 'z'))) return false;
+    for (const char *c = text; *c; c ++) {
+        bool letter = ((*c | 0x20) >= 'a') && ((*c | 0x20) <= 'z');
+        bool digit = (*c >= '0') && (*c <= '9');
+        if (!letter && !digit && (*c != '_')) return false;
+    }
+    return true;
+}
+
+static void apiAllocate_Isolate(WrenVM *vm) {
+    Isolate **payload = wrenSetSlotNewForeign(vm, 0, 0, sizeof(Isolate*));
+    *payload = NULL;
+    const char *module = wrenGetSlotString(vm, 1);
+    const char *variable = wrenGetSlotString(vm, 2);
+    if (!isValidModuleName(module) || !isIdentifier(variable)) {
+        wrenSetSlotString(vm, 0, "Isolate.spawn(..) takes a module name and the name of a "
+                "top-level variable in that module.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    Isolate *isolate = calloc(1, sizeof(Isolate));
+    isolate->channel = newChannel();
+    if (!isolate->channel) {
+        free(isolate);
+        wrenSetSlotString(vm, 0, "Could not create a channel for the isolate.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    const char *format =
+        "import \"std.isolate\" for Isolate\n"
+        "import \"%s\" for %s\n"
+        "%s.call(Isolate.parent)\n";
+    size_t sourceSize = strlen(format) + strlen(module) + 2 * strlen(variable) + 1;
+    isolate->source = malloc(sourceSize);
+    snprintf(isolate->source, sourceSize, format, module, variable, variable);
+    joinFinishedIsolates();
+    // One reference each for the Isolate object, the thread and liveIsolates, and one for each
+    // side of the channel plus a pin for liveIsolates.
+    isolate->refs = 3;
+    isolate->channel->refs[CHANNEL_PARENT] = 1;
+    isolate->channel->refs[CHANNEL_CHILD] = 1;
+    isolate->channel->pins = 1;
+    int error = pthread_create(&isolate->thread, NULL, &runIsolate, isolate);
+    if (error) {
+        // There's no thread and the isolate never reaches liveIsolates, so nothing will unpin the
+        // channel; drop the pin here so that releasing both sides frees it.
+        isolate->channel->pins = 0;
+        releaseChannel(isolate->channel, CHANNEL_CHILD);
+        releaseChannel(isolate->channel, CHANNEL_PARENT);
+        free(isolate->source);
+        free(isolate);
+        wrenSetSlotString(vm, 0, strerror(error));
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    pthread_mutex_lock(&isolatesLock);
+    isolate->next = liveIsolates;
+    liveIsolates = isolate;
+    pthread_mutex_unlock(&isolatesLock);
+    *payload = isolate;
+}
+
+// The thread is left in liveIsolates, to be joined by a later spawn or by joinIsolates().
+static void apiFinalize_Isolate(void *raw) {
+    Isolate *isolate = *(Isolate**)raw;
+    if (isolate) {
+        releaseChannel(isolate->channel, CHANNEL_PARENT);
+        releaseIsolate(isolate);
+    }
+}
+
+static void api_Isolate_channel_getter(WrenVM *vm) {
+    Isolate *isolate = *(Isolate**)wrenGetSlotForeign(vm, 0);
+    wrenEnsureSlots(vm, 2);
+    wrenGetVariable(vm, "std.isolate", "Channel", 1);
+    newChannelEnd(vm, 1, isolate->channel, CHANNEL_PARENT);
+}
+
+static void api_Isolate_isDone_getter(WrenVM *vm) {
+    Isolate *isolate = *(Isolate**)wrenGetSlotForeign(vm, 0);
+    wrenSetSlotBool(vm, 0, __atomic_load_n(&isolate->done, __ATOMIC_ACQUIRE));
+}
+
+static void api_Isolate_join_0(WrenVM *vm) {
+    Isolate *isolate = *(Isolate**)wrenGetSlotForeign(vm, 0);
+    pthread_mutex_lock(&isolatesLock);
+    bool claimed = !isolate->claimed;
+    isolate->claimed = true;
+    // Someone else (joinIsolates(), most likely) is joining it; wait for them.
+    while (!claimed && !isolate->joined) pthread_cond_wait(&isolateJoined, &isolatesLock);
+    pthread_mutex_unlock(&isolatesLock);
+    if (claimed) joinClaimedIsolate(isolate);
+    wrenSetSlotBool(vm, 0, isolate->succeeded);
+}
+
+// Close the parent side of every isolate's channel, so that any waiting on it see the channel
+// closed, and join their threads. Isolates that never look at their channel are simply waited
+// for. Called before the host's shared state is torn down; an isolate calling this (through
+// Process.exit(..), say) skips its own thread.
+void joinIsolates(void) {
+    while (true) {
+        Isolate *next = NULL;
+        pthread_mutex_lock(&isolatesLock);
+        for (Isolate *isolate = liveIsolates; isolate; isolate = isolate->next) {
+            if (!isolate->claimed && !pthread_equal(isolate->thread, pthread_self())) {
+                isolate->claimed = true;
+                next = isolate;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&isolatesLock);
+        if (!next) return;
+        ChannelShared *channel = next->channel;
+        pthread_mutex_lock(&channel->lock);
+        if (!channel->closed[CHANNEL_PARENT]) {
+            channel->closed[CHANNEL_PARENT] = true;
+            signalQueue(&channel->queues[CHANNEL_CHILD]);
+        }
+        pthread_mutex_unlock(&channel->lock);
+        joinClaimedIsolate(next);
+    }
+}
+
+void initIsolates(void) {
+    ggRegisterClass("Channel", &apiAllocate_Channel, &apiFinalize_Channel);
+    ggRegisterMethod("Channel", "static parent_", &apiStatic_Channel_parent_getter);
+    ggRegisterMethod("Channel", "send_(_)", &api_Channel_send_1);
+    ggRegisterMethod("Channel", "receive()", &api_Channel_receive_0);
+    ggRegisterMethod("Channel", "wait_()", &api_Channel_wait_0);
+    ggRegisterMethod("Channel", "fd", &api_Channel_fd_getter);
+    ggRegisterMethod("Channel", "isClosed", &api_Channel_isClosed_getter);
+    ggRegisterMethod("Channel", "close()", &api_Channel_close_0);
+
+    ggRegisterClass("Isolate", &apiAllocate_Isolate, &apiFinalize_Isolate);
+    ggRegisterMethod("Isolate", "channel", &api_Isolate_channel_getter);
+    ggRegisterMethod("Isolate", "isDone", &api_Isolate_isDone_getter);
+    ggRegisterMethod("Isolate", "join()", &api_Isolate_join_0);
+}
@@ -24,6 +24,12 @@
 
 /**************************************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -35,10 +41,14 @@
 /**************************************************************************************************/
 // Platform-specific includes
 #ifdef __linux__
+#include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #elif _WIN32
 #error
@@ -49,15 +59,21 @@
 
 #define GG_HOST
 #include <ggwren.h>
+#include <libggwren.h>
 
 #define GG_VERSION "0.0.1-indev"
 
 #define MAX_MODULE_SEARCH_PATHS             64
 #define MAX_COMPILATION_ERRORS_SHOWN         3
-#define WARNING "\x1b[33;1m[WARNING]\x1b[m "
-#define ERROR   "\x1b[31;1m[ERROR]\x1b[m "
-#define TRACE   "\x1b[36m[TRACE]\x1b[m "
-#define NOTE    "\x1b[36m[NOTE]\x1b[m "
+#define MAX_INTERPOLATION_DEPTH             16
+#define BUNDLE_MAGIC                0x42424747 /* "GGBB" */
+#define BUNDLE_FORMAT                        1
+#define BUNDLE_TRAILER_MAGIC        "GGBUNDLE"
+#define BUNDLE_MAIN                          0
+#define BUNDLE_MODULE                        1
+#define BUNDLE_EXTENSION                     2
+#define DIR_ENTRY_FILE                ((void*)1)
+#define DIR_ENTRY_DIR                 ((void*)2)
 #define HELP                                                                                       \
 "Usage:"                                                                         "\n"              \
 ""                                                                               "\n"              \
@@ -68,6 +84,73 @@
 "    -list-lib-paths      List the paths GGWren will search for modules."        "\n"              \
 ""                                                                               "\n"              \
 "    -lib=<path>          Add a module search path."                             "\n"              \
+""                                                                               "\n"              \
+"    -bundle=<path>       Write <script> and every module it imports to a"       "\n"              \
+"                         single bundle file instead of running it."             "\n"              \
+""                                                                               "\n"              \
+"    -bundle-exe          With -bundle, write a self-executing copy of GGWren"   "\n"              \
+"                         with the bundle appended to it."                       "\n"              \
+""                                                                               "\n"              \
+"    -bundle-extensions   With -bundle, also include the extensions (bin/*.so)"  "\n"              \
+"                         which the bundled modules bind."                       "\n"              \
+""                                                                               "\n"              \
+"    -run-bundle=<path>   Run a bundle; all following arguments are passed to"   "\n"              \
+"                         it. Imports are served from the bundle only."          "\n"              \
+""                                                                               "\n"              \
+"    -daemon=<socket>     Import the standard library once, then serve scripts"  "\n"              \
+"                         sent by -client from pre-forked warm workers. The"     "\n"              \
+"                         number of workers comes from -workers (4)."            "\n"              \
+""                                                                               "\n"              \
+"    -preload=<modules>   With -daemon, also import these comma-separated"       "\n"              \
+"                         modules before forking workers."                       "\n"              \
+""                                                                               "\n"              \
+"    -client[=<socket>]   Must come first. Run <script> and its arguments in the""\n"              \
+"                         daemon at <socket> (or $GG_DAEMON_SOCKET), with this"  "\n"              \
+"                         process's stdio, directory and environment."           "\n"              \
+""                                                                               "\n"              \
+"    -alloc=<kind>        Allocator for the Wren heap: `system` (the default)"   "\n"              \
+"                         or `slab`. See GG.memoryStats."                        "\n"              \
+""                                                                               "\n"              \
+"    -heap-initial=<size> Heap size before the first garbage collection. Sizes"  "\n"              \
+"                         may end in k, m or g."                                 "\n"              \
+""                                                                               "\n"              \
+"    -heap-min=<size>     Never schedule a collection below this heap size."     "\n"              \
+""                                                                               "\n"              \
+"    -heap-growth=<pct>   How far the heap may grow past the live data left by"  "\n"              \
+"                         a collection before the next one, in percent."         "\n"              \
+""                                                                               "\n"              \
+"    -workers=<count>     Default number of workers for Process.fork()."         "\n"              \
+""                                                                               "\n"              \
+"    -work-threads=<n>    Threads for background work (see std.work); defaults"  "\n"              \
+"                         to the number of CPUs."                                "\n"              \
+""                                                                               "\n"              \
+"    -flush=<policy>      When buffered script output is written: `line`,"       "\n"              \
+"                         `full` (when the buffer fills) or every `<n>ms`."      "\n"              \
+"                         Defaults to `line` on a terminal and `full`"           "\n"              \
+"                         otherwise. GG.flush() writes it at once."              "\n"              \
+""                                                                               "\n"              \
+"    -output-buffer=<size>"                                                      "\n"              \
+"                         Size of the script output buffer (64k)."               "\n"              \
+""                                                                               "\n"              \
+"    -metrics=<address>   Serve runtime metrics (see std.metrics) in the"        "\n"              \
+"                         Prometheus text format from the first TaskQueue, at"   "\n"              \
+"                         `unix:<path>` or `tcp:[<host>:]<port>` (host defaults" "\n"              \
+"                         to 127.0.0.1)."                                        "\n"              \
+""                                                                               "\n"              \
+"    -profile=<path>      Sample the Wren call stack while running and write it" "\n"              \
+"                         to <path> at exit, in folded format for flame graph"   "\n"              \
+"                         tools. Needs a build with GG_WREN_INTERNALS."          "\n"              \
+""                                                                               "\n"              \
+"    -profile-hz=<rate>   Samples per second of CPU time for -profile (100)."    "\n"              \
+""                                                                               "\n"              \
+"    -trace-foreign       Count and time every foreign method call. See"         "\n"              \
+"                         GG.foreignStats; a summary is printed at exit."        "\n"              \
+""                                                                               "\n"              \
+"    -startup-profile     Print a timeline of startup steps when GGWren exits."  "\n"              \
+""                                                                               "\n"              \
+"    -revalidate-module-index"                                                   "\n"              \
+"                         Re-check search path directories for changes before"   "\n"              \
+"                         trusting the module index (for long-lived processes)." "\n"              \
 ""                                                                               "\n"              
 
 #define GG_SOURCE                                                                                  \
@@ -79,6 +162,12 @@
 "    foreign static scriptPath"                                                  "\n"              \
 "    foreign static error"                                                       "\n"              \
 "    foreign static setModuleSource(name, source)"                               "\n"              \
+"    foreign static memoryStats"                                                 "\n"              \
+"    foreign static gc"                                                          "\n"              \
+"    foreign static collect()"                                                   "\n"              \
+"    foreign static foreignStats"                                                "\n"              \
+"    foreign static flush()"                                                     "\n"              \
+"    foreign static metricsAddress"                                              "\n"              \
 "}"                                                                              "\n"              \
 
 #define EXITCODE_OK /*..............................*/  0
@@ -97,7 +186,6 @@ struct ExtClass {
     const char *name;
     WrenForeignMethodFn allocate;
     WrenFinalizerFn finalize;
-    ExtClass *next;
 };
 
 typedef struct ExtMethod ExtMethod;
@@ -105,20 +193,110 @@ struct ExtMethod {
     const char *class;
     const char *signature;
     WrenForeignMethodFn fn;
-    ExtMethod *next;
 };
 
+// A stat(..) snapshot used to decide whether a directory has changed. A `sec` of -1 means the
+// path did not exist when the snapshot was taken.
+typedef struct ModuleStamp ModuleStamp;
+struct ModuleStamp {
+    int64_t sec;
+    int64_t nsec;
+    uint64_t size;
+};
+
+// A string-keyed hash table (open addressing, linear probing). Keys are copied; values are
+// owned by the caller.
+typedef struct TableEntry TableEntry;
+struct TableEntry {
+    char *key;
+    uint64_t hash;
+    void *value;
+};
+
+typedef struct Table Table;
+struct Table {
+    TableEntry *entries;
+    size_t count;
+    size_t capacity;
+};
+
+// The contents of one directory under a module search path, read once with readdir(..).
+typedef struct DirIndex DirIndex;
+struct DirIndex {
+    bool exists;
+    ModuleStamp stamp;
+    Table names;    // entry name -> DIR_ENTRY_FILE or DIR_ENTRY_DIR
+};
+
+// Where a module was found in the search paths; searchIndex is -1 for a module which is known
+// not to exist.
+typedef struct ModuleLocation ModuleLocation;
+struct ModuleLocation {
+    int searchIndex;
+    bool isPackage;
+};
+
+// Bundle layout: a BundleHeader, then `entryCount` BundleEntry records, then the names and
+// contents they point at (each NUL-terminated and 8-byte aligned). Offsets are relative to the
+// start of the header. A bundle appended to an executable is followed by a BundleTrailer.
+typedef struct BundleHeader BundleHeader;
+struct BundleHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t entryCount;
+    uint32_t reserved;
+    char version[24];
+    uint64_t size;
+};
+
+typedef struct BundleEntry BundleEntry;
+struct BundleEntry {
+    uint32_t kind;
+    uint32_t nameLength;
+    uint64_t nameOffset;
+    uint64_t dataOffset;
+    uint64_t dataLength;
+};
+
+typedef struct BundleTrailer BundleTrailer;
+struct BundleTrailer {
+    uint64_t offset;
+    uint64_t size;
+    char magic[8];
+};
+
+typedef struct BundleItem BundleItem;
+struct BundleItem {
+    uint32_t kind;
+    char *name;
+    char *data;
+    size_t length;
+    BundleItem *next;
+};
+
+typedef void (*ImportFoundFn)(const char *name, bool isExtension, void *data);
+
 typedef void* ExtHandle;
 ExtHandle openExt(const char *name);
 void closeExt(ExtHandle handle);
 void* getExtFn(ExtHandle handle, const char *name);
 
+// An extension linked into the executable itself; see "Static Extensions" in INSTALL.md.
+typedef struct StaticExt StaticExt;
+struct StaticExt {
+    const char *name;
+    ggExt_InitFn init;
+    ggExt_FinishFn finish;
+};
+const StaticExt* findStaticExt(const char *name);
+
 typedef struct Ext Ext;
 struct Ext {
     char *name;
     ExtHandle handle;
-    ExtClass *classes;
-    ExtMethod *methods;
+    const StaticExt *linked;    // Set instead of `handle` for statically linked extensions.
+    Table classes;  // class name -> ExtClass*
+    Table methods;  // "Class.signature" -> ExtMethod*
     Ext *next;
 };
 
@@ -130,6 +308,54 @@ struct Buffer {
     size_t count;
     size_t capacity_including_nul;
 };
+
+// Wren does not report the collections it schedules itself, so these cover GG.collect() only, and
+// GG.gc names them manual*.
+typedef struct GcStats GcStats;
+struct GcStats {
+    int collections;
+    uint64_t totalPauseNanoseconds;
+    uint64_t maxPauseNanoseconds;
+    size_t lastBytesBefore;
+    size_t lastBytesAfter;
+};
+
+// Host state belonging to one WrenVM (the main one or an isolate), reached through
+// wrenGetUserData(..).
+typedef struct VMContext VMContext;
+struct VMContext {
+    WrenVM *vm;
+    void *isolate;
+    Allocator allocator;
+    GcStats gcStats;
+    Ext *boundExtension;
+    Buffer foreignMethodSignature;
+    Buffer moduleName;
+    Buffer fullError;
+    Buffer bindError;       // The last foreign bind failure, under GG_LIBRARY (see bindFailed(..)).
+    bool errorSentinel;
+    int compilationErrorsShown;
+    int compilationErrorsHidden;
+    char *preboundModuleName;
+    char *preboundModuleSource;
+    int methodsBound;
+    int classesBound;
+    uint64_t methodBindNanoseconds;
+    uint64_t classBindNanoseconds;
+    int importStep;         // -startup-profile steps left open until the module is compiled.
+    int compileStep;
+    uint64_t loadStart;     // For -metrics.
+    bool freeCompiledSource;
+};
+
+// One step in the -startup-profile timeline.
+typedef struct StartupStep StartupStep;
+struct StartupStep {
+    char *label;
+    int depth;
+    uint64_t start;
+    uint64_t end;
+};
 void pushBuffer(Buffer *buffer, const char *string);
 void pushBytesToBuffer(Buffer *buffer, const uint8_t *bytes, size_t length);
 void printfBuffer(Buffer *buffer, const char *format, ...);
@@ -141,7 +367,24 @@ char* readEntireFile(const char* path, size_t* length);
 char* xsprintf(const char* format, ...);
 static inline char *dupString(const char *string);
 size_t nextPowerOfTwo(size_t x);
+uint64_t hashBytes(const void *data, size_t length);
+bool parseSize(const char *text, size_t *sizeOut);
+bool parseCount(const char *text, size_t *countOut);
+int beginStartupStep(const char *format, ...);
+void endStartupStep(int step);
+void addStartupStep(uint64_t start, const char *format, ...);
+void printStartupSteps(void);
+void* tableGet(Table *table, const char *key, size_t length);
+void tableSet(Table *table, const char *key, size_t length, void *value);
+void finishTable(Table *table, void (*freeValue)(void *value));
 void addModuleSearchPath(const char *path);
+bool locateModule(const char *relPath, uint32_t *searchIndexOut, bool *isPackageOut);
+char* findModule(const char *relPath, char **pathOut, uint32_t *searchIndexOut, bool *isPackageOut);
+void scanImports(const char *source, ImportFoundFn found, void *data);
+bool writeBundle(const char *outPath, bool executable);
+bool loadBundle(const char *path, bool requireTrailer);
+const char* bundleData(const BundleEntry *entry);
+const char* apiConfig_resolveModule(WrenVM *vm, const char* importer, const char* name);
 
 // Globals
 char **argv;
@@ -155,26 +398,56 @@ char* scriptDir = NULL;
 char* scriptSource = NULL;
 char* scriptModuleName = NULL;
 int scriptExitCode = EXITCODE_OK;
+int workerCount = 0;
+char* daemonPath = NULL;
+char* daemonPreload = NULL;
 const char *extError = NULL;
 char* moduleSearchPaths[MAX_MODULE_SEARCH_PATHS];
 int moduleSearchPathCount = 0;
 bool tooManyModuleSearchPaths = false;
 Ext* extensions = NULL;
 Ext* extBeingInitialized = NULL;
-Ext* boundExtension = NULL;
-WrenConfiguration config = {0};
+Buffer extMethodKey = {0};
 WrenVM* vm = NULL;
-Buffer foreignMethodSignature = {0};
 Buffer modulePath = {0};
 Buffer moduleNameTemp = {0};
 
-char* preboundModuleName = NULL;
-char* preboundModuleSource = NULL;
+// Guards everything shared between isolates: the extension list, the module index and
+// `modulePath`.
+pthread_mutex_t hostLock = PTHREAD_MUTEX_INITIALIZER;
+
+char* bundlePath = NULL;
+bool bundleExecutable = false;
+bool bundleExtensions = false;
+void* bundleMap = NULL;
+size_t bundleMapSize = 0;
+const uint8_t* bundleBase = NULL;
+const BundleEntry* bundleMain = NULL;
+Table bundleModules = {0};
+Table bundleExtensionTable = {0};
+
+Table moduleDirs = {0};
+Table moduleLocations = {0};
+bool revalidateModuleIndex = false;
 
-int compilationErrorsShown = 0;
-int compilationErrorsHidden = 0;
-Buffer fullError = {0};
-bool errorSentinel = false;
+AllocatorKind allocatorKind = ALLOCATOR_SYSTEM;
+
+// Tuning passed through to WrenConfiguration; zero means "keep Wren's default".
+size_t heapInitialSize = 0;
+size_t heapMinSize = 0;
+int heapGrowthPercent = 0;
+
+bool startupProfile = false;
+// Steps are recorded from the very start (before -startup-profile has been parsed) and
+// discarded after argument parsing if the flag is absent. Only the main VM records steps.
+bool startupRecording = true;
+StartupStep* startupSteps = NULL;
+int startupStepCount = 0;
+int startupStepCapacity = 0;
+int startupDepth = 0;
+bool traceForeign = false;
+char* profilePath = NULL;
+int profileHz = 100;
 
 GG_ABI abi = {
     #define GG_ABI_ENTRY(returnType, name, signature, params) .name = &name,
@@ -182,11 +455,58 @@ GG_ABI abi = {
     #undef GG_ABI_ENTRY
 };
 
+// GG_STATIC_EXTENSIONS(_) is defined by build.sh as `_(sqlite3) _(sodium) ..` for each
+// extension compiled with GG_STATIC_EXT, which renames its ggExt_init/ggExt_finish to
+// ggStatic_<name>_init/ggStatic_<name>_finish. ggExt_finish is optional, hence the weak symbol.
+#ifdef GG_STATIC_EXTENSIONS
+#define GG_STATIC_DECLARE(name) \
+    void ggStatic_##name##_init(void); \
+    void ggStatic_##name##_finish(void) __attribute__((weak));
+GG_STATIC_EXTENSIONS(GG_STATIC_DECLARE)
+#undef GG_STATIC_DECLARE
+#endif
+
+const StaticExt staticExtensions[] = {
+#ifdef GG_STATIC_EXTENSIONS
+    #define GG_STATIC_ENTRY(name) { #name, &ggStatic_##name##_init, &ggStatic_##name##_finish },
+    GG_STATIC_EXTENSIONS(GG_STATIC_ENTRY)
+    #undef GG_STATIC_ENTRY
+#endif
+    { NULL, NULL, NULL }
+};
+
 // Function implementations
+const StaticExt* findStaticExt(const char *name) {
+    for (const StaticExt *linked = staticExtensions; linked->name; linked ++) {
+        if (strcmp(linked->name, name) == 0) return linked;
+    }
+    return NULL;
+}
+
 ExtHandle openExt(const char *name) {
-    char* extPath = xsprintf("%s/bin/%s.ggwren.so", binDir, name);
+    char* extPath = NULL;
+    int memfd = -1;
+    const BundleEntry *bundled = tableGet(&bundleExtensionTable, name, strlen(name));
+    if (bundled) {
+        // dlopen(..) needs a file, so give it an anonymous one holding the bundled image.
+        memfd = memfd_create(name, MFD_CLOEXEC);
+        size_t written = 0;
+        while ((memfd >= 0) && (written < bundled->dataLength)) {
+            ssize_t count = write(memfd, &bundleData(bundled)[written],
+                    bundled->dataLength - written);
+            if (count < 0) {
+                close(memfd);
+                memfd = -1;
+            } else {
+                written += count;
+            }
+        }
+        if (memfd >= 0) extPath = xsprintf("/proc/self/fd/%d", memfd);
+    }
+    if (!extPath) extPath = xsprintf("%s/bin/%s.ggwren.so", binDir, name);
     ExtHandle handle = dlopen(extPath, RTLD_NOW | RTLD_LOCAL);
     free(extPath);
+    if (memfd >= 0) close(memfd);
     if (!handle) extError = dlerror();
     return handle;
 }
@@ -203,12 +523,14 @@ void* getExtFn(ExtHandle handle, const char *name) {
 
 void ggRegisterClass(const char *name, WrenForeignMethodFn allocate, WrenFinalizerFn finalize) {
     if (extBeingInitialized) {
-        ExtClass* class = malloc(sizeof(ExtClass));
+        ExtClass* class = tableGet(&extBeingInitialized->classes, name, strlen(name));
+        if (!class) {
+            class = malloc(sizeof(ExtClass));
+            tableSet(&extBeingInitialized->classes, name, strlen(name), class);
+        }
         class->name = name;
         class->allocate = allocate;
         class->finalize = finalize;
-        class->next = extBeingInitialized->classes;
-        extBeingInitialized->classes = class;
     } else {
         fprintf(stderr, WARNING "ggRegisterClass(..) was invoked by an extension outside "
                 "ggExt_init(..), which has no effect.\n");
@@ -217,12 +539,19 @@ void ggRegisterClass(const char *name, WrenForeignMethodFn allocate, WrenFinaliz
 
 void ggRegisterMethod(const char *className, const char *signature, WrenForeignMethodFn fn) {
     if (extBeingInitialized) {
-        ExtMethod* method = malloc(sizeof(ExtMethod));
+        clearBuffer(&extMethodKey);
+        pushBuffer(&extMethodKey, className);
+        pushBuffer(&extMethodKey, ".");
+        pushBuffer(&extMethodKey, signature);
+        Table *methods = &extBeingInitialized->methods;
+        ExtMethod* method = tableGet(methods, extMethodKey.bytes, extMethodKey.count);
+        if (!method) {
+            method = malloc(sizeof(ExtMethod));
+            tableSet(methods, extMethodKey.bytes, extMethodKey.count, method);
+        }
         method->class = className;
         method->signature = signature;
         method->fn = fn;
-        method->next = extBeingInitialized->methods;
-        extBeingInitialized->methods = method;
     } else {
         fprintf(stderr, WARNING "ggRegisterMethod(..) was invoked by an extension outside "
                 "ggExt_init(..), which has no effect.\n");
@@ -363,6 +692,185 @@ size_t nextPowerOfTwo(size_t x) {
     return x;
 }
 
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i ++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Parses a decimal byte count with an optional k, m or g suffix.
+bool parseSize(const char *text, size_t *sizeOut) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if ((end == text) || (errno != 0) || (text[0] == '-')) return false;
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': { shift = 10; end ++; } break;
+        case 'm': case 'M': { shift = 20; end ++; } break;
+        case 'g': case 'G': { shift = 30; end ++; } break;
+    }
+    if ((*end != '\0') || (value > (ULLONG_MAX >> shift))) return false;
+    value <<= shift;
+    if (value > SIZE_MAX) return false;
+    *sizeOut = (size_t)value;
+    return true;
+}
+
+// Parses a plain decimal count, with no suffix.
+bool parseCount(const char *text, size_t *countOut) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if ((end == text) || (errno != 0) || (text[0] == '-') || (*end != '\0')) return false;
+    if (value > SIZE_MAX) return false;
+    *countOut = (size_t)value;
+    return true;
+}
+
+uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int recordStartupStep(uint64_t start, const char *format, va_list args) {
+    if (startupStepCount >= startupStepCapacity) {
+        startupStepCapacity = startupStepCapacity ? startupStepCapacity * 2 : 64;
+        startupSteps = realloc(startupSteps, startupStepCapacity * sizeof(StartupStep));
+    }
+    StartupStep *step = &startupSteps[startupStepCount];
+    va_list args2;
+    va_copy(args2, args);
+    char c[2];
+    size_t length = vsnprintf(c, 2, format, args);
+    step->label = malloc(length + 1);
+    vsnprintf(step->label, length + 1, format, args2);
+    va_end(args2);
+    step->depth = startupDepth;
+    step->start = start;
+    step->end = 0;
+    return startupStepCount ++;
+}
+
+// Open a step in the -startup-profile timeline. Steps opened before it is closed are nested
+// under it. Returns -1 (which endStartupStep(..) ignores) when not recording.
+int beginStartupStep(const char *format, ...) {
+    if (!startupRecording) return -1;
+    va_list args;
+    va_start(args, format);
+    int step = recordStartupStep(monotonicNanoseconds(), format, args);
+    va_end(args);
+    startupDepth ++;
+    return step;
+}
+
+void endStartupStep(int step) {
+    if (step < 0 || !startupRecording) return;
+    startupSteps[step].end = monotonicNanoseconds();
+    startupDepth = startupSteps[step].depth;
+}
+
+// Record a step that started at `start` and has just finished.
+void addStartupStep(uint64_t start, const char *format, ...) {
+    if (!startupRecording) return;
+    va_list args;
+    va_start(args, format);
+    int step = recordStartupStep(start, format, args);
+    va_end(args);
+    startupSteps[step].end = monotonicNanoseconds();
+}
+
+void printStartupSteps(void) {
+    if (startupStepCount == 0) return;
+    uint64_t epoch = startupSteps[0].start;
+    fprintf(stderr, NOTE "Startup timeline (start and duration in ms):\n\n");
+    for (int i = 0; i < startupStepCount; i ++) {
+        StartupStep *step = &startupSteps[i];
+        if (step->end) {
+            fprintf(stderr, "%10.3f %10.3f  %*s%s\n", (step->start - epoch) / 1e6,
+                    (step->end - step->start) / 1e6, step->depth * 2, "", step->label);
+        } else {
+            fprintf(stderr, "%10.3f %10s  %*s%s\n", (step->start - epoch) / 1e6, "-",
+                    step->depth * 2, "", step->label);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+uint64_t hashBytes(const void *data, size_t length) {
+    return fnv1a(0xcbf29ce484222325ull, data, length);
+}
+
+static TableEntry* findTableEntry(Table *table, const char *key, size_t length, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask; table->entries[i].key; i = (i + 1) & mask) {
+        TableEntry *entry = &table->entries[i];
+        if ((entry->hash == hash) && (strncmp(entry->key, key, length) == 0) &&
+                (entry->key[length] == 0))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void* tableGet(Table *table, const char *key, size_t length) {
+    if (table->count == 0) return NULL;
+    TableEntry *entry = findTableEntry(table, key, length, hashBytes(key, length));
+    return entry ? entry->value : NULL;
+}
+
+void tableSet(Table *table, const char *key, size_t length, void *value) {
+    uint64_t hash = hashBytes(key, length);
+    if (table->count > 0) {
+        TableEntry *entry = findTableEntry(table, key, length, hash);
+        if (entry) {
+            entry->value = value;
+            return;
+        }
+    }
+    if (((table->count + 1) * 2) > table->capacity) {
+        Table grown = {0};
+        grown.capacity = table->capacity ? table->capacity * 2 : 16;
+        grown.entries = calloc(grown.capacity, sizeof(TableEntry));
+        for (size_t i = 0; i < table->capacity; i ++) {
+            TableEntry *old = &table->entries[i];
+            if (old->key) {
+                size_t j = old->hash & (grown.capacity - 1);
+                while (grown.entries[j].key) j = (j + 1) & (grown.capacity - 1);
+                grown.entries[j] = *old;
+            }
+        }
+        grown.count = table->count;
+        if (table->entries) free(table->entries);
+        *table = grown;
+    }
+    size_t i = hash & (table->capacity - 1);
+    while (table->entries[i].key) i = (i + 1) & (table->capacity - 1);
+    char *copy = malloc(length + 1);
+    memcpy(copy, key, length);
+    copy[length] = 0;
+    table->entries[i].key = copy;
+    table->entries[i].hash = hash;
+    table->entries[i].value = value;
+    table->count ++;
+}
+
+void finishTable(Table *table, void (*freeValue)(void *value)) {
+    for (size_t i = 0; i < table->capacity; i ++) {
+        if (table->entries[i].key) {
+            if (freeValue) freeValue(table->entries[i].value);
+            free(table->entries[i].key);
+        }
+    }
+    if (table->entries) free(table->entries);
+    memset(table, 0, sizeof(Table));
+}
+
 void addModuleSearchPath(const char *path) {
     if (moduleSearchPathCount < MAX_MODULE_SEARCH_PATHS) {
         moduleSearchPaths[moduleSearchPathCount] = path ? dupString(path) : NULL;
@@ -372,6 +880,501 @@ void addModuleSearchPath(const char *path) {
     }
 }
 
+static void stampPath(const char *path, ModuleStamp *stamp) {
+    struct stat st;
+    memset(stamp, 0, sizeof(ModuleStamp));
+    if (path && (stat(path, &st) >= 0)) {
+        stamp->sec = (int64_t)st.st_mtim.tv_sec;
+        stamp->nsec = (int64_t)st.st_mtim.tv_nsec;
+        stamp->size = S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0;
+    } else {
+        stamp->sec = -1;
+    }
+}
+
+static bool writeAll(FILE *f, const void *data, size_t length) {
+    return fwrite(data, 1, length, f) == length;
+}
+
+static void freeDirIndex(void *value) {
+    DirIndex *dir = value;
+    finishTable(&dir->names, NULL);
+    free(dir);
+}
+
+static void scanDirIndex(DirIndex *dir, const char *path) {
+    finishTable(&dir->names, NULL);
+    stampPath(path, &dir->stamp);
+    DIR *handle = opendir(path);
+    dir->exists = handle != NULL;
+    if (!handle) return;
+    struct dirent *entry;
+    while ((entry = readdir(handle))) {
+        unsigned char type = entry->d_type;
+        if ((type == DT_UNKNOWN) || (type == DT_LNK)) {
+            struct stat st;
+            char *entryPath = xsprintf("%s/%s", path, entry->d_name);
+            if (stat(entryPath, &st) >= 0) {
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            free(entryPath);
+        }
+        if (type == DT_REG) {
+            tableSet(&dir->names, entry->d_name, strlen(entry->d_name), DIR_ENTRY_FILE);
+        } else if (type == DT_DIR) {
+            tableSet(&dir->names, entry->d_name, strlen(entry->d_name), DIR_ENTRY_DIR);
+        }
+    }
+    closedir(handle);
+}
+
+// Fetch the index for a directory, reading it on first use. In revalidating mode a directory
+// whose mtime has moved is re-read, and every remembered module location is forgotten since
+// any of them might now resolve differently.
+static DirIndex* indexDir(const char *root, const char *relDir, int relDirLength) {
+    Buffer path = {0};
+    if (relDirLength) printfBuffer(&path, "%s/%.*s", root, relDirLength, relDir);
+    else printfBuffer(&path, "%s", root);
+    DirIndex *dir = tableGet(&moduleDirs, path.bytes, path.count);
+    if (!dir) {
+        dir = calloc(1, sizeof(DirIndex));
+        scanDirIndex(dir, path.bytes);
+        tableSet(&moduleDirs, path.bytes, path.count, dir);
+    } else if (revalidateModuleIndex) {
+        ModuleStamp stamp;
+        stampPath(path.bytes, &stamp);
+        if (memcmp(&stamp, &dir->stamp, sizeof(ModuleStamp)) != 0) {
+            scanDirIndex(dir, path.bytes);
+            finishTable(&moduleLocations, &free);
+        }
+    }
+    finishBuffer(&path);
+    return dir;
+}
+
+// Work out which search path holds `relPath` using only the directory index, so that the
+// module can then be read with a single open(..). Results (including misses) are remembered,
+// making repeated resolution a single table lookup.
+bool locateModule(const char *relPath, uint32_t *searchIndexOut, bool *isPackageOut) {
+    size_t relLength = strlen(relPath);
+    ModuleLocation *location = revalidateModuleIndex ? NULL :
+            tableGet(&moduleLocations, relPath, relLength);
+    if (!location) {
+        const char *slash = strrchr(relPath, '/');
+        int dirLength = slash ? (int)(slash - relPath) : 0;
+        const char *base = slash ? slash + 1 : relPath;
+        Buffer fileName = {0};
+        printfBuffer(&fileName, "%s.wren", base);
+        location = malloc(sizeof(ModuleLocation));
+        location->searchIndex = -1;
+        location->isPackage = false;
+        for (int i = 0; (location->searchIndex < 0) && (i < moduleSearchPathCount); i ++) {
+            if (!moduleSearchPaths[i]) continue;
+            DirIndex *dir = indexDir(moduleSearchPaths[i], relPath, dirLength);
+            if (!dir->exists) continue;
+            if (tableGet(&dir->names, fileName.bytes, fileName.count) == DIR_ENTRY_FILE) {
+                location->searchIndex = i;
+            } else if (tableGet(&dir->names, base, strlen(base)) == DIR_ENTRY_DIR) {
+                DirIndex *package = indexDir(moduleSearchPaths[i], relPath, relLength);
+                if (tableGet(&package->names, "lib.wren", 8) == DIR_ENTRY_FILE) {
+                    location->searchIndex = i;
+                    location->isPackage = true;
+                }
+            }
+        }
+        finishBuffer(&fileName);
+        ModuleLocation *previous = tableGet(&moduleLocations, relPath, relLength);
+        if (previous) free(previous);
+        tableSet(&moduleLocations, relPath, relLength, location);
+    }
+    if (location->searchIndex < 0) return false;
+    *searchIndexOut = location->searchIndex;
+    *isPackageOut = location->isPackage;
+    return true;
+}
+
+// Find `relPath` (a module name with dots turned into slashes) in the module search paths.
+// On success, returns the module source and hands back the path it was read from along with
+// where in the search order it was found.
+char* findModule(const char *relPath, char **pathOut, uint32_t *searchIndexOut,
+        bool *isPackageOut) {
+    char *source = NULL;
+    if (locateModule(relPath, searchIndexOut, isPackageOut)) {
+        printfBuffer(&modulePath, *isPackageOut ? "%s/%s/lib.wren" : "%s/%s.wren",
+                moduleSearchPaths[*searchIndexOut], relPath);
+        source = readEntireFile(modulePath.bytes, NULL);
+        if (source) *pathOut = dupString(modulePath.bytes);
+    }
+    return source;
+}
+
+// Scan Wren source for `import "..."` statements and `GG.bind("...")` calls, reporting each
+// name found. This is a lexer rather than a parser: it understands comments, raw strings and
+// (nested) string interpolation well enough to never mistake their contents for code.
+static bool scanStringBody(const char *src, size_t *cursor, Buffer *value, int *interpDepths,
+        int *interpCount) {
+    size_t i = *cursor;
+    while (src[i] && (src[i] != '"')) {
+        if ((src[i] == '\\') && src[i + 1]) {
+            if (value) pushBytesToBuffer(value, (const uint8_t*)&src[i + 1], 1);
+            i += 2;
+        } else if ((src[i] == '%') && (src[i + 1] == '(')) {
+            if (*interpCount < MAX_INTERPOLATION_DEPTH) interpDepths[(*interpCount)++] = 1;
+            *cursor = i + 2;
+            return false;
+        } else {
+            if (value) pushBytesToBuffer(value, (const uint8_t*)&src[i], 1);
+            i ++;
+        }
+    }
+    *cursor = src[i] ? i + 1 : i;
+    return true;
+}
+
+void scanImports(const char *src, ImportFoundFn found, void *data) {
+    enum { TOKEN_OTHER, TOKEN_IMPORT, TOKEN_DOT, TOKEN_BIND, TOKEN_BIND_PAREN } last = TOKEN_OTHER;
+    int interpDepths[MAX_INTERPOLATION_DEPTH];
+    int interpCount = 0;
+    Buffer value = {0};
+    size_t i = 0;
+    while (src[i]) {
+        char c = src[i];
+        if ((c == '/') && (src[i + 1] == '/')) {
+            while (src[i] && (src[i] != '\n')) i ++;
+        } else if ((c == '/') && (src[i + 1] == '*')) {
+            int depth = 0;
+            do {
+                if ((src[i] == '/') && (src[i + 1] == '*')) {
+                    depth ++;
+                    i += 2;
+                } else if ((src[i] == '*') && (src[i + 1] == '/')) {
+                    depth --;
+                    i += 2;
+                } else {
+                    i ++;
+                }
+            } while (src[i] && depth);
+        } else if ((c == '"') && (src[i + 1] == '"') && (src[i + 2] == '"')) {
+            const char *end = strstr(&src[i + 3], "\"\"\"");
+            i = end ? (size_t)(end - src) + 3 : strlen(src);
+            last = TOKEN_OTHER;
+        } else if (c == '"') {
+            clearBuffer(&value);
+            pushBuffer(&value, "");
+            i ++;
+            int outerCount = interpCount;
+            bool complete = scanStringBody(src, &i, &value, interpDepths, &interpCount);
+            if (complete && (interpCount == outerCount)) {
+                if (last == TOKEN_IMPORT) found(value.bytes, false, data);
+                if (last == TOKEN_BIND_PAREN) found(value.bytes, true, data);
+            }
+            last = TOKEN_OTHER;
+        } else if ((c == '_') || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'))) {
+            size_t start = i;
+            while ((src[i] == '_') || ((src[i] >= 'a') && (src[i] <= 'z')) ||
+                    ((src[i] >= 'A') && (src[i] <= 'Z')) || ((src[i] >= '0') && (src[i] <= '9')))
+            {
+                i ++;
+            }
+            size_t length = i - start;
+            if ((length == 6) && (strncmp(&src[start], "import", 6) == 0)) {
+                last = TOKEN_IMPORT;
+            } else if ((length == 4) && (strncmp(&src[start], "bind", 4) == 0) &&
+                    (last == TOKEN_DOT)) {
+                last = TOKEN_BIND;
+            } else {
+                last = TOKEN_OTHER;
+            }
+        } else if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')) {
+            i ++;
+        } else {
+            if (c == '.') {
+                last = TOKEN_DOT;
+            } else if ((c == '(') && (last == TOKEN_BIND)) {
+                last = TOKEN_BIND_PAREN;
+            } else {
+                last = TOKEN_OTHER;
+            }
+            if ((c == '(') && interpCount) interpDepths[interpCount - 1] ++;
+            i ++;
+            if ((c == ')') && interpCount && (--interpDepths[interpCount - 1] == 0)) {
+                interpCount --;
+                scanStringBody(src, &i, NULL, interpDepths, &interpCount);
+            }
+        }
+    }
+    finishBuffer(&value);
+}
+
+typedef struct BundleBuild BundleBuild;
+struct BundleBuild {
+    Table seen;
+    BundleItem *items;
+    BundleItem *lastItem;
+    const char *importer;
+    char **pending;
+    size_t pendingCount;
+    size_t pendingCapacity;
+    bool ok;
+};
+
+static void addBundleItem(BundleBuild *build, uint32_t kind, const char *name, char *data,
+        size_t length) {
+    BundleItem *item = malloc(sizeof(BundleItem));
+    item->kind = kind;
+    item->name = dupString(name);
+    item->data = data;
+    item->length = length;
+    item->next = NULL;
+    if (build->lastItem) build->lastItem->next = item;
+    else build->items = item;
+    build->lastItem = item;
+}
+
+static void bundleImportFound(const char *name, bool isExtension, void *data) {
+    BundleBuild *build = data;
+    if (isExtension) {
+        if (!bundleExtensions || (strcmp(name, "builtins") == 0)) return;
+        if (findStaticExt(name)) return;
+        Buffer key = {0};
+        printfBuffer(&key, "bin/%s", name);
+        if (!tableGet(&build->seen, key.bytes, key.count)) {
+            tableSet(&build->seen, key.bytes, key.count, DIR_ENTRY_FILE);
+            char *extPath = xsprintf("%s/bin/%s.ggwren.so", binDir, name);
+            size_t length;
+            char *image = readEntireFile(extPath, &length);
+            if (image) {
+                addBundleItem(build, BUNDLE_EXTENSION, name, image, length);
+            } else {
+                fprintf(stderr, WARNING "Could not read extension `%s` from `%s`; it will be "
+                        "loaded from disk when the bundle runs.\n", name, extPath);
+            }
+            free(extPath);
+        }
+        finishBuffer(&key);
+    } else {
+        char *resolved = (char*)apiConfig_resolveModule(NULL, build->importer, name);
+        if ((strcmp(resolved, "gg") == 0) || (strcmp(resolved, "meta") == 0) ||
+                (strcmp(resolved, "random") == 0) ||
+                tableGet(&build->seen, resolved, strlen(resolved))) {
+            free(resolved);
+            return;
+        }
+        tableSet(&build->seen, resolved, strlen(resolved), DIR_ENTRY_FILE);
+        if (build->pendingCount == build->pendingCapacity) {
+            build->pendingCapacity = build->pendingCapacity ? build->pendingCapacity * 2 : 16;
+            build->pending = realloc(build->pending, build->pendingCapacity * sizeof(char*));
+        }
+        build->pending[build->pendingCount++] = resolved;
+    }
+}
+
+// Follow the import graph from the root script and write every module it reaches (plus,
+// with -bundle-extensions, the extensions they bind) into a single image. Imports are found
+// by scanning source, so modules imported through Meta.eval(..) or computed names are not
+// seen; those can be listed with a literal `import` in the root script.
+bool writeBundle(const char *outPath, bool executable) {
+    BundleBuild build = {0};
+    build.ok = true;
+    addBundleItem(&build, BUNDLE_MAIN, scriptModuleName, dupString(scriptSource),
+            strlen(scriptSource));
+    tableSet(&build.seen, scriptModuleName, strlen(scriptModuleName), DIR_ENTRY_FILE);
+    build.importer = scriptModuleName;
+    scanImports(scriptSource, &bundleImportFound, &build);
+    for (size_t next = 0; next < build.pendingCount; next ++) {
+        char *name = build.pending[next];
+        clearBuffer(&moduleNameTemp);
+        bool invalid = false;
+        for (const char *c = name; *c; c ++) {
+            if ((*c == '/') || (*c == '\\') || (*c < 32) || (*c > 126)) invalid = true;
+            pushBytesToBuffer(&moduleNameTemp, (const uint8_t*)((*c == '.') ? "/" : c), 1);
+        }
+        char *path = NULL;
+        uint32_t searchIndex;
+        bool isPackage;
+        char *source = invalid ? NULL :
+                findModule(moduleNameTemp.bytes, &path, &searchIndex, &isPackage);
+        if (source) {
+            addBundleItem(&build, BUNDLE_MODULE, name, source, strlen(source));
+            build.importer = name;
+            scanImports(source, &bundleImportFound, &build);
+            fprintf(stderr, NOTE "Bundled module `%s` from `%s`.\n", name, path);
+            free(path);
+        } else {
+            fprintf(stderr, ERROR "Could not find module `%s` to bundle.\n", name);
+            build.ok = false;
+        }
+    }
+
+    size_t itemCount = 0;
+    for (BundleItem *item = build.items; item; item = item->next) itemCount ++;
+    uint64_t offset = sizeof(BundleHeader) + itemCount * sizeof(BundleEntry);
+    BundleHeader header = {0};
+    header.magic = BUNDLE_MAGIC;
+    header.format = BUNDLE_FORMAT;
+    header.entryCount = itemCount;
+    strncpy(header.version, GG_VERSION, sizeof(header.version) - 1);
+    BundleEntry *entries = calloc(itemCount + 1, sizeof(BundleEntry));
+    size_t index = 0;
+    for (BundleItem *item = build.items; item; item = item->next, index ++) {
+        entries[index].kind = item->kind;
+        entries[index].nameLength = strlen(item->name);
+        entries[index].nameOffset = offset;
+        offset += entries[index].nameLength + 1;
+        offset = (offset + 7) & ~(uint64_t)7;
+        entries[index].dataOffset = offset;
+        entries[index].dataLength = item->length;
+        offset += item->length + 1;
+        offset = (offset + 7) & ~(uint64_t)7;
+    }
+    header.size = offset;
+
+    FILE *f = build.ok ? fopen(outPath, "wb") : NULL;
+    if (build.ok && !f) {
+        fprintf(stderr, ERROR "Could not open `%s` for writing.\n", outPath);
+        build.ok = false;
+    }
+    uint64_t bundleOffset = 0;
+    if (build.ok && executable) {
+        size_t length;
+        char *image = binPath ? readEntireFile(binPath, &length) : NULL;
+        if (image) {
+            build.ok = writeAll(f, image, length);
+            bundleOffset = (length + 7) & ~(size_t)7;
+            static const uint8_t padding[8] = {0};
+            if (build.ok) build.ok = writeAll(f, padding, bundleOffset - length);
+            free(image);
+        } else {
+            fprintf(stderr, ERROR "Could not read the GGWren executable to build a "
+                    "self-executing bundle.\n");
+            build.ok = false;
+        }
+    }
+    if (build.ok) {
+        build.ok = writeAll(f, &header, sizeof(header)) &&
+                writeAll(f, entries, itemCount * sizeof(BundleEntry));
+    }
+    index = 0;
+    uint64_t written = sizeof(BundleHeader) + itemCount * sizeof(BundleEntry);
+    for (BundleItem *item = build.items; build.ok && item; item = item->next, index ++) {
+        static const uint8_t zeroes[8] = {0};
+        build.ok = writeAll(f, zeroes, entries[index].nameOffset - written) &&
+                writeAll(f, item->name, entries[index].nameLength + 1) &&
+                writeAll(f, zeroes, entries[index].dataOffset - entries[index].nameOffset
+                        - entries[index].nameLength - 1) &&
+                writeAll(f, item->data, item->length) &&
+                writeAll(f, zeroes, 1);
+        written = entries[index].dataOffset + item->length + 1;
+    }
+    if (build.ok) {
+        static const uint8_t zeroes[8] = {0};
+        build.ok = writeAll(f, zeroes, header.size - written);
+    }
+    if (build.ok && executable) {
+        BundleTrailer trailer = {0};
+        trailer.offset = bundleOffset;
+        trailer.size = header.size;
+        memcpy(trailer.magic, BUNDLE_TRAILER_MAGIC, sizeof(trailer.magic));
+        build.ok = writeAll(f, &trailer, sizeof(trailer));
+    }
+    if (f && (fclose(f) != 0)) build.ok = false;
+    if (build.ok && executable) (void)chmod(outPath, 0755);
+    if (build.ok) {
+        fprintf(stderr, NOTE "Wrote %zu module%s to `%s`.\n", itemCount,
+                itemCount != 1 ? "s" : "", outPath);
+    } else if (f) {
+        (void)unlink(outPath);
+    }
+
+    BundleItem *nextItem;
+    for (BundleItem *item = build.items; item; item = nextItem) {
+        nextItem = item->next;
+        free(item->name);
+        free(item->data);
+        free(item);
+    }
+    for (size_t i = 0; i < build.pendingCount; i ++) free(build.pending[i]);
+    if (build.pending) free(build.pending);
+    finishTable(&build.seen, NULL);
+    free(entries);
+    return build.ok;
+}
+
+// Map a bundle into memory. `path` may be a bare bundle or an executable with a bundle
+// appended to it; with `requireTrailer` only the latter is accepted (used when checking the
+// running executable for a payload).
+bool loadBundle(const char *path, bool requireTrailer) {
+    int f = open(path, O_RDONLY);
+    if (f < 0) return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    bool hasTrailer = false;
+    if ((fstat(f, &st) >= 0) && (st.st_size >= sizeof(BundleHeader))) {
+        BundleTrailer trailer;
+        hasTrailer = (pread(f, &trailer, sizeof(trailer), st.st_size - sizeof(trailer))
+                == sizeof(trailer)) &&
+                (memcmp(trailer.magic, BUNDLE_TRAILER_MAGIC, sizeof(trailer.magic)) == 0);
+        if (hasTrailer || !requireTrailer) {
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+        }
+    }
+    close(f);
+    if (map == MAP_FAILED) return false;
+
+    const uint8_t *base = map;
+    size_t size = st.st_size;
+    const BundleTrailer *trailer = (const BundleTrailer*)(&base[size - sizeof(BundleTrailer)]);
+    bool ok = true;
+    if (hasTrailer) {
+        ok = (trailer->offset <= size) && (trailer->size <= (size - trailer->offset));
+        if (ok) {
+            base = &base[trailer->offset];
+            size = trailer->size;
+        }
+    }
+    const BundleHeader *header = (const BundleHeader*)base;
+    ok = ok && (size >= sizeof(BundleHeader)) && (header->magic == BUNDLE_MAGIC) &&
+            (header->format == BUNDLE_FORMAT) && (header->size <= size) &&
+            (header->entryCount <= (size - sizeof(BundleHeader)) / sizeof(BundleEntry));
+    if (ok && (strncmp(header->version, GG_VERSION, sizeof(header->version)) != 0)) {
+        fprintf(stderr, WARNING "Bundle `%s` was built by GGWren %.*s; this is %s.\n", path,
+                (int)sizeof(header->version), header->version, GG_VERSION);
+    }
+    const BundleEntry *entries = (const BundleEntry*)(&header[1]);
+    for (uint32_t i = 0; ok && (i < header->entryCount); i ++) {
+        const BundleEntry *entry = &entries[i];
+        ok = (entry->nameOffset < size) && (entry->nameLength < (size - entry->nameOffset)) &&
+                (entry->dataOffset < size) && (entry->dataLength < (size - entry->dataOffset)) &&
+                (base[entry->nameOffset + entry->nameLength] == 0) &&
+                (base[entry->dataOffset + entry->dataLength] == 0);
+        if (!ok) break;
+        const char *name = (const char*)(&base[entry->nameOffset]);
+        if (entry->kind == BUNDLE_MAIN) {
+            bundleMain = entry;
+        } else if (entry->kind == BUNDLE_MODULE) {
+            tableSet(&bundleModules, name, entry->nameLength, (void*)entry);
+        } else if (entry->kind == BUNDLE_EXTENSION) {
+            tableSet(&bundleExtensionTable, name, entry->nameLength, (void*)entry);
+        }
+    }
+    if (ok && !bundleMain) ok = false;
+    if (!ok) {
+        finishTable(&bundleModules, NULL);
+        finishTable(&bundleExtensionTable, NULL);
+        bundleMain = NULL;
+        munmap(map, st.st_size);
+        return false;
+    }
+    bundleMap = map;
+    bundleMapSize = st.st_size;
+    bundleBase = base;
+    return true;
+}
+
+const char* bundleData(const BundleEntry *entry) {
+    return (const char*)(&bundleBase[entry->dataOffset]);
+}
+
 void apiStatic_GG_ggVersion_getter(WrenVM* vm) {
     wrenSetSlotString(vm, 0, GG_VERSION);
 }
@@ -381,33 +1384,65 @@ void apiStatic_GG_wrenVersion_getter(WrenVM* vm) {
 }
 
 void apiStatic_GG_bind_1(WrenVM* vm) {
+    VMContext *ctx = wrenGetUserData(vm);
     WrenType t = wrenGetSlotType(vm, 1);
     if (t == WREN_TYPE_STRING) {
         Ext* result = NULL;
         const char* name = wrenGetSlotString(vm, 1);
+        pthread_mutex_lock(&hostLock);
         for (Ext* ext = extensions; !result && ext; ext = ext->next) {
             if (strcmp(ext->name, name) == 0) {
                 result = ext;
             }
         }
+        const StaticExt *linked = result ? NULL : findStaticExt(name);
+        if (linked) {
+            int bindStep = ctx->isolate ? -1 : beginStartupStep("bind extension %s", name);
+            Ext* ext = malloc(sizeof(Ext));
+            ext->name = dupString(name);
+            ext->handle = NULL;
+            ext->linked = linked;
+            memset(&ext->classes, 0, sizeof(Table));
+            memset(&ext->methods, 0, sizeof(Table));
+            ext->next = extensions;
+            extensions = ext;
+            int initStep = ctx->isolate ? -1 : beginStartupStep("ggExt_init (linked)");
+            extBeingInitialized = ext;
+            linked->init();
+            extBeingInitialized = NULL;
+            endStartupStep(initStep);
+            endStartupStep(bindStep);
+            result = ext;
+        }
         if (!result) {
+            int bindStep = ctx->isolate ? -1 : beginStartupStep("bind extension %s", name);
+            int openStep = ctx->isolate ? -1 : beginStartupStep("open");
             ExtHandle handle = openExt(name);
+            endStartupStep(openStep);
             if (handle) {
                 Ext* ext = malloc(sizeof(Ext));
                 ext->name = dupString(name);
                 ext->handle = handle;
-                ext->classes = NULL;
-                ext->methods = NULL;
+                ext->linked = NULL;
+                memset(&ext->classes, 0, sizeof(Table));
+                memset(&ext->methods, 0, sizeof(Table));
                 ext->next = extensions;
                 extensions = ext;
                 ggExt_BootstrapFn extBootstrap = getExtFn(handle, "ggExt_bootstrap");
                 ggExt_InitFn extInit = getExtFn(handle, "ggExt_init");
-                if (extBootstrap) {
+                // Extensions built before GG_ABI_VERSION existed don't export it.
+                const int *extAbiVersion = getExtFn(handle, "ggExt_abiVersion");
+                if (extAbiVersion && (*extAbiVersion > GG_ABI_VERSION)) {
+                    extError = "The extension was built for a newer version of GGWren (its "
+                            "GG_ABI_VERSION is\nhigher than this executable's).";
+                } else if (extBootstrap) {
                     if (extBootstrap(&abi) == GG_BOOTSTRAP_OK) {
                         if (extInit) {
+                            int initStep = ctx->isolate ? -1 : beginStartupStep("ggExt_init");
                             extBeingInitialized = ext;
                             extInit();
                             extBeingInitialized = NULL;
+                            endStartupStep(initStep);
                         }
                         result = ext;
                     } else {
@@ -421,15 +1456,36 @@ void apiStatic_GG_bind_1(WrenVM* vm) {
                 }
             }
             if (!result) {
+#ifdef GG_LIBRARY
+                // libggwren must not exit its host, so forget the extension and fail the bind.
+                if (handle) {
+                    Ext *ext = extensions;
+                    extensions = ext->next;
+                    free(ext->name);
+                    free(ext);
+                    closeExt(handle);
+                }
+                endStartupStep(bindStep);
+                pthread_mutex_unlock(&hostLock);
+                char *message = xsprintf("Could not load extension `%s`. %s", name, extError);
+                size_t length = strlen(message);
+                if (length && (message[length - 1] == '\n')) message[length - 1] = 0;
+                wrenSetSlotString(vm, 0, message);
+                free(message);
+                wrenAbortFiber(vm, 0);
+                return;
+#else
                 fprintf(stderr, ERROR "Could not load extension `%s`.\n", name);
                 fprintf(stderr, ERROR "%s\n", extError);
                 exit(EXITCODE_COULD_NOT_LOAD_EXTENSION);
-                if (handle) closeExt(handle);
+#endif
             }
+            endStartupStep(bindStep);
         }
-        boundExtension = result;
+        pthread_mutex_unlock(&hostLock);
+        ctx->boundExtension = result;
     } else if (t == WREN_TYPE_NULL) {
-        boundExtension = NULL;
+        ctx->boundExtension = NULL;
     } else {
         wrenSetSlotString(vm, 0, "The argument to `bind(..)` must be either a String or null.");
         wrenAbortFiber(vm, 0);
@@ -445,22 +1501,94 @@ void apiStatic_GG_scriptDir_getter(WrenVM* vm) {
 }
 
 void apiStatic_GG_error_getter(WrenVM* vm) {
-    wrenSetSlotBytes(vm, 0, fullError.bytes, fullError.count);
+    VMContext *ctx = wrenGetUserData(vm);
+    wrenSetSlotBytes(vm, 0, ctx->fullError.bytes, ctx->fullError.count);
+}
+
+static void setMapNum(WrenVM* vm, int mapSlot, const char *key, double value) {
+    wrenSetSlotString(vm, mapSlot + 1, key);
+    wrenSetSlotDouble(vm, mapSlot + 2, value);
+    wrenSetMapValue(vm, mapSlot, mapSlot + 1, mapSlot + 2);
+}
+
+void apiStatic_GG_memoryStats_getter(WrenVM* vm) {
+    Allocator *allocator = &((VMContext*)wrenGetUserData(vm))->allocator;
+    wrenEnsureSlots(vm, 7);
+    wrenSetSlotNewMap(vm, 0);
+    wrenSetSlotString(vm, 1, "allocator");
+    wrenSetSlotString(vm, 2, (allocator->kind == ALLOCATOR_SLAB) ? "slab" : "system");
+    wrenSetMapValue(vm, 0, 1, 2);
+    setMapNum(vm, 0, "liveBytes", allocator->liveBytes);
+    setMapNum(vm, 0, "peakBytes", allocator->peakBytes);
+    setMapNum(vm, 0, "slabBytes", allocator->reservedBytes);
+    setMapNum(vm, 0, "allocations", allocator->allocations);
+    setMapNum(vm, 0, "frees", allocator->frees);
+    wrenSetSlotNewList(vm, 3);
+    for (int i = 0; i <= ALLOCATOR_SIZE_CLASSES; i ++) {
+        wrenSetSlotNewMap(vm, 4);
+        // Allocations above the largest size class are reported with a size of null.
+        wrenSetSlotString(vm, 5, "size");
+        if (i < ALLOCATOR_SIZE_CLASSES) {
+            wrenSetSlotDouble(vm, 6, allocatorClassSize(i));
+        } else {
+            wrenSetSlotNull(vm, 6);
+        }
+        wrenSetMapValue(vm, 4, 5, 6);
+        setMapNum(vm, 4, "live", allocator->classes[i].live);
+        setMapNum(vm, 4, "liveBytes", allocator->classes[i].liveBytes);
+        setMapNum(vm, 4, "allocations", allocator->classes[i].allocations);
+        wrenInsertInList(vm, 3, -1, 4);
+    }
+    wrenSetSlotString(vm, 1, "sizeClasses");
+    wrenSetMapValue(vm, 0, 1, 3);
+}
+
+void apiStatic_GG_gc_getter(WrenVM* vm) {
+    VMContext *ctx = wrenGetUserData(vm);
+    GcStats *gcStats = &ctx->gcStats;
+    wrenEnsureSlots(vm, 3);
+    wrenSetSlotNewMap(vm, 0);
+    setMapNum(vm, 0, "manualCollections", gcStats->collections);
+    setMapNum(vm, 0, "manualTotalPause", gcStats->totalPauseNanoseconds / 1e9);
+    setMapNum(vm, 0, "manualMaxPause", gcStats->maxPauseNanoseconds / 1e9);
+    setMapNum(vm, 0, "manualBytesBefore", gcStats->lastBytesBefore);
+    setMapNum(vm, 0, "manualBytesAfter", gcStats->lastBytesAfter);
+    setMapNum(vm, 0, "liveBytes", ctx->allocator.liveBytes);
+    setMapNum(vm, 0, "heapInitial", heapInitialSize);
+    setMapNum(vm, 0, "heapMin", heapMinSize);
+    setMapNum(vm, 0, "heapGrowth", heapGrowthPercent);
+}
+
+void apiStatic_GG_collect_0(WrenVM* vm) {
+    VMContext *ctx = wrenGetUserData(vm);
+    GcStats *gcStats = &ctx->gcStats;
+    size_t before = ctx->allocator.liveBytes;
+    uint64_t start = monotonicNanoseconds();
+    wrenCollectGarbage(vm);
+    uint64_t pause = monotonicNanoseconds() - start;
+    gcStats->collections ++;
+    gcStats->totalPauseNanoseconds += pause;
+    if (pause > gcStats->maxPauseNanoseconds) gcStats->maxPauseNanoseconds = pause;
+    gcStats->lastBytesBefore = before;
+    gcStats->lastBytesAfter = ctx->allocator.liveBytes;
+    wrenSetSlotNull(vm, 0);
 }
 
 void apiStatic_GG_setModuleSource_2(WrenVM* vm) {
-    if (preboundModuleName) free(preboundModuleName);
-    if (preboundModuleSource) free(preboundModuleSource);
-    preboundModuleName = dupString(wrenGetSlotString(vm, 1));
-    preboundModuleSource = dupString(wrenGetSlotString(vm, 2));
+    VMContext *ctx = wrenGetUserData(vm);
+    if (ctx->preboundModuleName) free(ctx->preboundModuleName);
+    if (ctx->preboundModuleSource) free(ctx->preboundModuleSource);
+    ctx->preboundModuleName = dupString(wrenGetSlotString(vm, 1));
+    ctx->preboundModuleSource = dupString(wrenGetSlotString(vm, 2));
     wrenSetSlotNull(vm, 0);
 }
 
 void apiConfig_write(WrenVM* vm, const char* text) {
-    printf("%s", text);
+    writeOutput(text, strlen(text));
 }
 
 const char* apiConfig_input(WrenVM* vm) {
+    flushOutput();
     char* line = NULL;
     size_t n;
     ssize_t count = getline(&line, &n, stdin);
@@ -479,68 +1607,98 @@ void apiConfig_error(
     int line,
     const char* message
 ) {
-    if (errorSentinel) {
-        errorSentinel = false;
-        clearBuffer(&fullError);
-        compilationErrorsShown = 0;
-        compilationErrorsHidden = 0;
+    VMContext *ctx = wrenGetUserData(vm);
+    if (ctx->errorSentinel) {
+        ctx->errorSentinel = false;
+        clearBuffer(&ctx->fullError);
+        ctx->compilationErrorsShown = 0;
+        ctx->compilationErrorsHidden = 0;
     }
-    if ((type != WREN_ERROR_COMPILE) && (compilationErrorsHidden > 0)) {
-        appendPrintfBuffer(&fullError, NOTE "(%d additional error%s not shown)\n",
-                compilationErrorsHidden, compilationErrorsHidden != 1 ? "s" : "");
-        compilationErrorsHidden = 0;
+    if ((type != WREN_ERROR_COMPILE) && (ctx->compilationErrorsHidden > 0)) {
+        appendPrintfBuffer(&ctx->fullError, NOTE "(%d additional error%s not shown)\n",
+                ctx->compilationErrorsHidden, ctx->compilationErrorsHidden != 1 ? "s" : "");
+        ctx->compilationErrorsHidden = 0;
     }
     switch (type) {
         case WREN_ERROR_COMPILE: {
-            if (compilationErrorsShown >= MAX_COMPILATION_ERRORS_SHOWN) {
+            if (ctx->compilationErrorsShown >= MAX_COMPILATION_ERRORS_SHOWN) {
             } else {
-                appendPrintfBuffer(&fullError,  ERROR "(In module `%s` on line %d) %s\n",
+                appendPrintfBuffer(&ctx->fullError,  ERROR "(In module `%s` on line %d) %s\n",
                         module, line, message);
-                compilationErrorsShown ++;
+                ctx->compilationErrorsShown ++;
             }
         } break;
         case WREN_ERROR_STACK_TRACE: {
-            appendPrintfBuffer(&fullError, TRACE "In module `%s`, line %d, in `%s`\n",
+            appendPrintfBuffer(&ctx->fullError, TRACE "In module `%s`, line %d, in `%s`\n",
                     module, line, message);
         } break;
         case WREN_ERROR_RUNTIME: {
-            appendPrintfBuffer(&fullError, ERROR "%s\n", message);
+            appendPrintfBuffer(&ctx->fullError, ERROR "%s\n", message);
         } break;
         case WREN_ERROR_END_OF_FRAME: {
-            errorSentinel = true;
+            ctx->errorSentinel = true;
         } break;
     }
 }
 
+// Report a foreign class or method that can't be bound, which ends the executable with `exitCode`.
+// libggwren must not take its host down, so there the message is kept in `ctx->bindError` and the
+// caller binds apiUnbound(..) instead, which aborts the fiber with it once the class is
+// constructed or the method called.
+static void bindFailed(WrenVM *vm, int exitCode, const char *format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    (void)vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+#ifdef GG_LIBRARY
+    VMContext *ctx = wrenGetUserData(vm);
+    printfBuffer(&ctx->bindError, "%s", message);
+#else
+    fprintf(stderr, ERROR "%s\n", message);
+    exit(exitCode);
+#endif
+}
+
+static void apiUnbound(WrenVM *vm) {
+    VMContext *ctx = wrenGetUserData(vm);
+    wrenSetSlotBytes(vm, 0, ctx->bindError.bytes, ctx->bindError.count);
+    wrenAbortFiber(vm, 0);
+}
+
 WrenForeignClassMethods apiConfig_bindForeignClass(
     WrenVM *vm,
     const char* module,
     const char* name
 ) {
+    VMContext *ctx = wrenGetUserData(vm);
+    uint64_t bindStart = monotonicNanoseconds();
     WrenForeignClassMethods result = {0};
 
     if (strcmp(module, "meta") == 0) {
         // do nothing
     } else if (strcmp(module, "random") == 0) {
         // do nothing
-    } else if (boundExtension) {
-        for (ExtClass *class=boundExtension->classes; !result.allocate && class;class=class->next) {
-            if (strcmp(class->name, name) == 0) {
-                result.allocate = class->allocate;
-                result.finalize = class->finalize;
-            }
+    } else if (ctx->boundExtension) {
+        ExtClass *class = tableGet(&ctx->boundExtension->classes, name, strlen(name));
+        if (class) {
+            result.allocate = class->allocate;
+            result.finalize = class->finalize;
         }
         if (!result.allocate) {
-            fprintf(stderr, ERROR "Module `%s` defines foreign class `%s`, but bound "
-                    "extension `%s` does not implement it.\n", module,
-                    name, boundExtension->name);
-            exit(EXITCODE_COULD_NOT_BIND_FOREIGN_CLASS);
+            bindFailed(vm, EXITCODE_COULD_NOT_BIND_FOREIGN_CLASS, "Module `%s` defines foreign "
+                    "class `%s`, but bound extension `%s` does not implement it.", module,
+                    name, ctx->boundExtension->name);
+            result.allocate = &apiUnbound;
+            result.finalize = NULL;
         }
     } else {
-        fprintf(stderr, ERROR "Module `%s` defines foreign class `%s` without first "
-                "calling GG.bind(..).\n", module, name);
-        exit(EXITCODE_COULD_NOT_BIND_FOREIGN_CLASS);
+        bindFailed(vm, EXITCODE_COULD_NOT_BIND_FOREIGN_CLASS, "Module `%s` defines foreign class "
+                "`%s` without first calling GG.bind(..).", module, name);
+        result.allocate = &apiUnbound;
     }
+    ctx->classesBound ++;
+    ctx->classBindNanoseconds += monotonicNanoseconds() - bindStart;
     return result;
 }
 
@@ -551,8 +1709,12 @@ WrenForeignMethodFn apiConfig_bindForeignMethod(
     bool isStatic,
     const char* signature
 ) {
-    foreignMethodSignature.count = 0;
-    printfBuffer(&foreignMethodSignature, "%s%s", isStatic ? "static " : "", signature);
+    VMContext *ctx = wrenGetUserData(vm);
+    uint64_t bindStart = monotonicNanoseconds();
+    clearBuffer(&ctx->foreignMethodSignature);
+    pushBuffer(&ctx->foreignMethodSignature, class);
+    pushBuffer(&ctx->foreignMethodSignature, isStatic ? ".static " : ".");
+    pushBuffer(&ctx->foreignMethodSignature, signature);
     WrenForeignMethodFn result = NULL;
     if (strcmp(module, "gg") == 0) {
         if      (strcmp(signature, "ggVersion") == 0)    result = &apiStatic_GG_ggVersion_getter;
@@ -562,38 +1724,50 @@ WrenForeignMethodFn apiConfig_bindForeignMethod(
         else if (strcmp(signature, "scriptPath") == 0)   result = &apiStatic_GG_scriptPath_getter;
         else if (strcmp(signature, "setModuleSource(_,_)") == 0) result = &apiStatic_GG_setModuleSource_2;
         else if (strcmp(signature, "error") == 0)   result = &apiStatic_GG_error_getter;
+        else if (strcmp(signature, "memoryStats") == 0) result = &apiStatic_GG_memoryStats_getter;
+        else if (strcmp(signature, "gc") == 0)           result = &apiStatic_GG_gc_getter;
+        else if (strcmp(signature, "collect()") == 0)    result = &apiStatic_GG_collect_0;
+        else if (strcmp(signature, "foreignStats") == 0) result = &apiStatic_GG_foreignStats_getter;
+        else if (strcmp(signature, "flush()") == 0)      result = &apiStatic_GG_flush_0;
+        else if (strcmp(signature, "metricsAddress") == 0) {
+            result = &apiStatic_GG_metricsAddress_getter;
+        }
         else {
-            fprintf(stderr, "Internal error: gg declares non-existent method `%s`\n", signature);
-            exit(EXITCODE_FATAL_ERROR);
+            bindFailed(vm, EXITCODE_FATAL_ERROR, "Internal error: gg declares non-existent method "
+                    "`%s`.", signature);
+            result = &apiUnbound;
         }
     } else if (strcmp(module, "meta") == 0) {
         // do nothing
     } else if (strcmp(module, "random") == 0) {
         // do nothing
-    } else if (boundExtension) {
-        for (ExtMethod *method = boundExtension->methods; !result && method; method= method->next) {
-            if ((strcmp(method->class, class) == 0) &&
-                (strcmp(method->signature, foreignMethodSignature.bytes) == 0))
-            {
-                result = method->fn;
-            }
-        }
+    } else if (ctx->boundExtension) {
+        ExtMethod *method = tableGet(&ctx->boundExtension->methods, ctx->foreignMethodSignature.bytes,
+                ctx->foreignMethodSignature.count);
+        if (method) result = method->fn;
         if (!result) {
-            fprintf(stderr, ERROR "Module `%s` defines foreign %smethod `%s.%s`, but bound "
-                    "extension `%s` does not implement it.\n", module, isStatic ? "static " : "",
-                    class, signature, boundExtension->name);
-            exit(EXITCODE_COULD_NOT_BIND_FOREIGN_METHOD);
+            bindFailed(vm, EXITCODE_COULD_NOT_BIND_FOREIGN_METHOD, "Module `%s` defines foreign "
+                    "%smethod `%s.%s`, but bound extension `%s` does not implement it.", module,
+                    isStatic ? "static " : "", class, signature, ctx->boundExtension->name);
+            result = &apiUnbound;
         }
     } else {
-        fprintf(stderr, ERROR "Module `%s` defines foreign %smethod `%s.%s` without first "
-                "calling GG.bind(..).\n", module, isStatic ? "static " : "", class, signature);
-        exit(EXITCODE_COULD_NOT_BIND_FOREIGN_METHOD);
+        bindFailed(vm, EXITCODE_COULD_NOT_BIND_FOREIGN_METHOD, "Module `%s` defines foreign "
+                "%smethod `%s.%s` without first calling GG.bind(..).", module,
+                isStatic ? "static " : "", class, signature);
+        result = &apiUnbound;
     }
 
+    if (traceForeign && result) {
+        result = traceForeignMethod(module, ctx->foreignMethodSignature.bytes, result);
+    }
+    ctx->methodsBound ++;
+    ctx->methodBindNanoseconds += monotonicNanoseconds() - bindStart;
     return result;
 }
 
 const char* apiConfig_resolveModule(WrenVM *vm, const char* importer, const char* name) {
+    uint64_t start = monotonicNanoseconds();
     char* result = malloc(strlen(importer)+strlen(name)+2);
     if (name[0] == '.') {
         strcpy(result, importer);
@@ -622,106 +1796,531 @@ const char* apiConfig_resolveModule(WrenVM *vm, const char* importer, const char
     } else {
         strcpy(result, name);
     }
+    VMContext *ctx = vm ? wrenGetUserData(vm) : NULL;
+    if (ctx && !ctx->isolate) addStartupStep(start, "resolve %s from %s", result, importer);
     return result;
 }
 
+void* apiConfig_reallocate(void *memory, size_t newSize, void *userData) {
+    return ggReallocate(memory, newSize, &((VMContext*)userData)->allocator);
+}
+
 void apiConfig_loadModuleComplete(WrenVM* vm, const char* module, WrenLoadModuleResult result) {
     if (result.source) free((void*)(result.source));
 }
 
+// Used instead of apiConfig_loadModuleComplete(..) while recording the startup timeline, since
+// Wren calls it as soon as the module has been compiled.
+void apiConfig_loadModuleCompiled(WrenVM* vm, const char* module, WrenLoadModuleResult result) {
+    VMContext *ctx = wrenGetUserData(vm);
+    endStartupStep(ctx->compileStep);
+    endStartupStep(ctx->importStep);
+    if (metricsAddress && !ctx->isolate) {
+        recordModuleLoad(module, monotonicNanoseconds() - ctx->loadStart);
+    }
+    if (ctx->freeCompiledSource) apiConfig_loadModuleComplete(vm, module, result);
+}
+
 WrenLoadModuleResult apiConfig_loadModule(WrenVM* vm, const char* name) {
+    VMContext *ctx = wrenGetUserData(vm);
+    Buffer *moduleName = &ctx->moduleName;
     WrenLoadModuleResult result = {0};
+    bool recording = startupRecording && !ctx->isolate;
+    int importStep = recording ? beginStartupStep("import %s", name) : -1;
+    uint64_t loadStart = monotonicNanoseconds();
+    const char *loadedFrom = "not found";
     bool invalid_chars_in_name = false;
-    clearBuffer(&moduleNameTemp);
+    clearBuffer(moduleName);
     size_t name_count = strlen(name);
     for (size_t i = 0; i < name_count; i ++) {
         if ((name[i] == '/') || (name[i] == '\\') || (name[i] < 32) || (name[i] > 126)) {
             invalid_chars_in_name = true;
             break;
         } else if (name[i] == '.') {
-            pushBuffer(&moduleNameTemp,"/");
+            pushBuffer(moduleName,"/");
         } else {
-            pushBytesToBuffer(&moduleNameTemp, &name[i], 1);
+            pushBytesToBuffer(moduleName, &name[i], 1);
         }
     }
     if (strcmp(name, "gg") == 0) {
         result.source = GG_SOURCE;
-    } else if (preboundModuleName && (strcmp(name, preboundModuleName) == 0)) {
-        result.source = preboundModuleSource;
+        loadedFrom = "built in";
+    } else if (ctx->preboundModuleName && (strcmp(name, ctx->preboundModuleName) == 0)) {
+        result.source = ctx->preboundModuleSource;
+        loadedFrom = "GG.setModuleSource";
+    } else if (bundleMain) {
+        const BundleEntry *entry = tableGet(&bundleModules, name, name_count);
+        result.source = entry ? bundleData(entry) : NULL;
+        if (entry) loadedFrom = "bundle";
     } else if (invalid_chars_in_name) {
         result.source = NULL;
+        loadedFrom = "invalid name";
     } else {
-        for (size_t i = 0; i < moduleSearchPathCount; i ++) {
-            printfBuffer(&modulePath, "%s/%s.wren", moduleSearchPaths[i], moduleNameTemp.bytes);
-            result.source = readEntireFile(modulePath.bytes, NULL);
-            if (result.source) break;
-            printfBuffer(&modulePath, "%s/%s/lib.wren",moduleSearchPaths[i], moduleNameTemp.bytes);
-            result.source = readEntireFile(modulePath.bytes, NULL);
-            if (result.source) break;
-        }
+        pthread_mutex_lock(&hostLock);
+        char *path;
+        uint32_t searchIndex;
+        bool isPackage;
+        result.source = findModule(moduleName->bytes, &path, &searchIndex, &isPackage);
         if (result.source) {
+            free(path);
             result.onComplete = apiConfig_loadModuleComplete;
+            loadedFrom = "search paths";
         }
+        pthread_mutex_unlock(&hostLock);
+    }
+    if (recording) addStartupStep(loadStart, "load (%s)", loadedFrom);
+    if ((recording || (metricsAddress && !ctx->isolate)) && result.source) {
+        ctx->importStep = importStep;
+        ctx->compileStep = beginStartupStep("compile");
+        ctx->loadStart = loadStart;
+        ctx->freeCompiledSource = (result.onComplete == apiConfig_loadModuleComplete);
+        result.onComplete = apiConfig_loadModuleCompiled;
+    } else {
+        endStartupStep(importStep);
     }
     return result;
 }
 
-int main(int argc_, char** argv_) {
-    enum {
-        OK,
-        INVALID_COMMAND_LINE_ARGS,
-        FATAL_ERROR,
-        COULD_NOT_READ_SCRIPT_SOURCE,
-        SCRIPT_COMPILATION_ERROR,
-        SCRIPT_RUNTIME_ERROR
+WrenVM* newHostVM(void *isolate) {
+    VMContext *ctx = calloc(1, sizeof(VMContext));
+    ctx->isolate = isolate;
+    initAllocator(&ctx->allocator, allocatorKind);
+    WrenConfiguration config;
+    wrenInitConfiguration(&config);
+    config.writeFn = &apiConfig_write;
+    config.readFn = &apiConfig_input;
+    config.errorFn = &apiConfig_error;
+    config.bindForeignMethodFn = &apiConfig_bindForeignMethod;
+    config.bindForeignClassFn = &apiConfig_bindForeignClass;
+    config.loadModuleFn = &apiConfig_loadModule;
+    config.resolveModuleFn = &apiConfig_resolveModule;
+    config.reallocateFn = &apiConfig_reallocate;
+    if (heapInitialSize) config.initialHeapSize = heapInitialSize;
+    if (heapMinSize) config.minHeapSize = heapMinSize;
+    if (heapGrowthPercent) config.heapGrowthPercent = heapGrowthPercent;
+    config.userData = ctx;
+    ctx->vm = wrenNewVM(&config);
+    return ctx->vm;
+}
+
+void freeHostVM(WrenVM *vm) {
+    VMContext *ctx = wrenGetUserData(vm);
+    wrenFreeVM(vm);
+    finishAllocator(&ctx->allocator);
+    finishBuffer(&ctx->foreignMethodSignature);
+    finishBuffer(&ctx->moduleName);
+    finishBuffer(&ctx->fullError);
+    finishBuffer(&ctx->bindError);
+    if (ctx->preboundModuleName) free(ctx->preboundModuleName);
+    if (ctx->preboundModuleSource) free(ctx->preboundModuleSource);
+    free(ctx);
+}
+
+const char* hostError(WrenVM *vm) {
+    VMContext *ctx = wrenGetUserData(vm);
+    flushOutput(); // The error is about to be printed; it should come after the output.
+    return ctx->fullError.bytes ? (const char*)ctx->fullError.bytes : "";
+}
+
+void* hostIsolate(WrenVM *vm) {
+    return ((VMContext*)wrenGetUserData(vm))->isolate;
+}
+
+const Allocator* hostAllocator(WrenVM *vm) {
+    return &((VMContext*)wrenGetUserData(vm))->allocator;
+}
+
+void hostGcStats(WrenVM *vm, int *collectionsOut, uint64_t *pauseNanosecondsOut) {
+    GcStats *gcStats = &((VMContext*)wrenGetUserData(vm))->gcStats;
+    *collectionsOut = gcStats->collections;
+    *pauseNanosecondsOut = gcStats->totalPauseNanoseconds;
+}
+
+// Find the executable (binPath) and the directory holding it (binDir), which is where
+// extensions and the standard library are looked for. Both stay NULL if this fails.
+bool locateExecutable(void) {
+    bool ok = true;
+    size_t capacity = 0;
+    ssize_t length = 0;
+    while (ok && (length >= capacity)) {
+        capacity = capacity ? capacity << 1 : 256;
+        binPath = realloc(binPath, capacity);
+        length = readlink("/proc/self/exe", binPath, capacity);
+        if (length < 0) {
+            fprintf(stderr, ERROR "Failed to read location of the GGWren executable "
+                    "readlink(..) failed.\n");
+            ok = false;
+        } else if (length < capacity) {
+            binPath[length] = 0;    // readlink(..) doesn't terminate the path.
+        }
+    }
+    if (ok) {
+        char *realBinPath = realpath(binPath, NULL);
+        if (realBinPath) {
+            free(binPath);
+            binPath = realBinPath;
+        } else {
+            fprintf(stderr, ERROR "Failed to read location of the GGWren executable "
+                    "realpath(..) failed.\n");
+            ok = false;
+        }
+    }
+    if (!ok) {
+        if (binPath) free(binPath);
+        binPath = NULL;
+    }
+    if (binPath) {
+        char *tempBinPath = dupString(binPath);
+        binDir = dupString(dirname(tempBinPath));
+        free(tempBinPath);
+    }
+    return ok;
+}
+
+// Search paths after the script's directory: bin/../lib next to the executable, GG_LIB and the
+// system-wide library.
+void addDefaultSearchPaths(void) {
+    char *libDir = xsprintf("%s/lib", binDir);
+    if (binDir) addModuleSearchPath(libDir);
+    free(libDir);
+    if (getenv("GG_LIB")) {
+        int start = 0;
+        char *lib = getenv("GG_LIB");
+        for (int index = 0; lib[index]; index ++) {
+            if (lib[index] == ':') {
+                int length = index - start;
+                if (length) {
+                    char* path = malloc(length + 1);
+                    memcpy(path, &lib[start], length);
+                    path[length] = 0;
+                    addModuleSearchPath(path);
+                    free(path);
+                }
+                start = index + 1;
+            }
+        }
+        int length = strlen(lib) - start;
+        if (length) {
+            char* path = malloc(length + 1);
+            memcpy(path, &lib[start], length);
+            path[length] = 0;
+            addModuleSearchPath(path);
+            free(path);
+        }
+    }
+    addModuleSearchPath("/usr/lib/ggwren");
+    if (tooManyModuleSearchPaths) {
+        fprintf(stderr, "\x1b[33;1m[WARNING]\x1b[m ");
+        fprintf(stderr, "Too many module search paths were added (the limit is %d); the extras\n"
+                "were ignored.\n", MAX_MODULE_SEARCH_PATHS);
+    }
+}
+
+void registerBuiltins(void) {
+    Ext* ext = malloc(sizeof(Ext));
+    ext->name = dupString("builtins");
+    ext->handle = NULL;
+    ext->linked = NULL;
+    memset(&ext->classes, 0, sizeof(Table));
+    memset(&ext->methods, 0, sizeof(Table));
+    ext->next = extensions;
+    extensions = ext;
+    extBeingInitialized = ext;
+    initBuiltins();
+    initIsolates();
+    initTimers();
+    initWork();
+    initOutput();
+    initMetrics();
+    extBeingInitialized = NULL;
+}
+
+// Finish and unload every extension and free the state shared by all host VMs, after stopping
+// any isolates still running. No VM may be used afterwards.
+void finishHost(void) {
+    joinIsolates();
+    finishWork();
+    Ext* nextExt;
+    for (Ext *ext = extensions; ext; ext = nextExt) {
+        if (ext->handle) {
+            ggExt_FinishFn extFinish = getExtFn(ext->handle, "ggExt_finish");
+            if (extFinish) extFinish();
+            closeExt(ext->handle);
+        } else if (ext->linked && ext->linked->finish) {
+            ext->linked->finish();
+        }
+        finishTable(&ext->classes, &free);
+        finishTable(&ext->methods, &free);
+        nextExt = ext->next;
+        free(ext->name);
+        free(ext);
+    }
+    extensions = NULL;
+    for (size_t i = 0; i < moduleSearchPathCount; i ++) {
+        free(moduleSearchPaths[i]);
+    }
+    moduleSearchPathCount = 0;
+    if (binPath) free(binPath);
+    if (binDir) free(binDir);
+    binPath = binDir = NULL;
+    finishBuffer(&extMethodKey);
+    finishBuffer(&modulePath);
+    finishBuffer(&moduleNameTemp);
+    finishTable(&moduleDirs, &freeDirIndex);
+    finishTable(&moduleLocations, &free);
+}
+
+/**************************************************************************************************/
+
+// The embedding API (see include/libggwren.h). Runtimes are host VMs like the CLI's; the
+// search paths, extensions and module index are shared by all of them and set up once.
+
+struct GGRuntime {
+    WrenVM *vm;
+};
+
+static pthread_once_t embedOnce = PTHREAD_ONCE_INIT;
+static bool embedInitialized = false;
+static char *embedHome = NULL;
+static size_t embedSearchPathCount = 0;
+
+// In an embedder /proc/self/exe is the host program, so look for the installation next to the
+// object holding this code instead: libggwren.so, or the host itself when linked statically.
+static bool locateLibrary(void) {
+    Dl_info info;
+    if (!dladdr((void*)&ggNewRuntime, &info) || !info.dli_fname) return false;
+    char *path = realpath(info.dli_fname, NULL);
+    if (!path) return false;
+    binPath = path;
+    char *tempBinPath = dupString(binPath);
+    binDir = dupString(dirname(tempBinPath));
+    free(tempBinPath);
+    return true;
+}
+
+static void initEmbedding(void) {
+    startupRecording = false;
+    addModuleSearchPath(NULL);
+    if (embedHome) {
+        binDir = embedHome;
+        embedHome = NULL;
+    } else if (!locateLibrary()) {
+        (void)locateExecutable();
+    }
+    addDefaultSearchPaths();
+    registerBuiltins();
+    embedInitialized = true;
+}
+
+bool ggSetHome(const char *dir) {
+    if (embedInitialized) return false;
+    if (embedHome) free(embedHome);
+    embedHome = dupString(dir);
+    return true;
+}
+
+bool ggAddSearchPath(const char *path) {
+    pthread_once(&embedOnce, &initEmbedding);
+    pthread_mutex_lock(&hostLock);
+    // Remembered module locations are indices into the search paths, so they are fixed once a
+    // module has been imported.
+    bool ok = (moduleLocations.count == 0) && (moduleSearchPathCount < MAX_MODULE_SEARCH_PATHS);
+    if (ok) {
+        // Embedder paths go in front of the defaults, in the order they were added.
+        size_t index = 1 + embedSearchPathCount ++;
+        memmove(&moduleSearchPaths[index + 1], &moduleSearchPaths[index],
+                (moduleSearchPathCount - index) * sizeof(char*));
+        moduleSearchPaths[index] = dupString(path);
+        moduleSearchPathCount ++;
+    }
+    pthread_mutex_unlock(&hostLock);
+    return ok;
+}
+
+void ggSetArguments(int count, char **arguments) {
+    scriptArgc = count;
+    scriptArgv = arguments;
+}
+
+GGRuntime* ggNewRuntime(void) {
+    pthread_once(&embedOnce, &initEmbedding);
+    GGRuntime *runtime = malloc(sizeof(GGRuntime));
+    runtime->vm = newHostVM(NULL);
+    return runtime;
+}
+
+void ggFreeRuntime(GGRuntime *runtime) {
+    freeHostVM(runtime->vm);
+    free(runtime);
+}
+
+WrenVM* ggRuntimeVM(GGRuntime *runtime) {
+    return runtime->vm;
+}
+
+WrenInterpretResult ggRunSource(GGRuntime *runtime, const char *module, const char *source) {
+    return wrenInterpret(runtime->vm, module, source);
+}
+
+// Whether `name` can be spliced into an import statement: it must not be able to end the string
+// or start an interpolation.
+bool isValidModuleName(const char *name) {
+    if (name[0] == 0) return false;
+    for (const char *c = name; *c; c ++) {
+        if ((*c == '"') || (*c == '\\') || (*c == '%') || (*c < 32) || (*c > 126)) return false;
+    }
+    return true;
+}
+
+WrenInterpretResult ggRunModule(GGRuntime *runtime, const char *module) {
+    if (!isValidModuleName(module)) {
+        VMContext *ctx = wrenGetUserData(runtime->vm);
+        clearBuffer(&ctx->fullError);
+        appendPrintfBuffer(&ctx->fullError, ERROR "ggRunModule(..) was given an invalid module "
+                "name.\n");
+        return WREN_RESULT_COMPILE_ERROR;
+    }
+    char *source = xsprintf("import \"%s\"\n", module);
+    WrenInterpretResult result = wrenInterpret(runtime->vm, "<embed>", source);
+    free(source);
+    return result;
+}
+
+WrenInterpretResult ggCallHandle(GGRuntime *runtime, WrenHandle *method) {
+    return wrenCall(runtime->vm, method);
+}
+
+const char* ggRuntimeError(GGRuntime *runtime) {
+    return hostError(runtime->vm);
+}
+
+void ggShutdown(void) {
+    finishHost();
+}
+
+#ifndef GG_LIBRARY
+// Run one script sent to a -daemon worker. The worker is a fork of the daemon, so `vm` already
+// has the standard library imported; only the script's own modules are loaded here.
+static int runDaemonScript(int count, char **arguments) {
+    if (count < 1) {
+        fprintf(stderr, ERROR "No script was given to the daemon.\n");
+        return EXITCODE_INVALID_COMMAND_LINE_ARGS;
+    }
+    scriptPath = realpath(arguments[0], NULL);
+    if (!scriptPath) scriptPath = dupString(arguments[0]);
+    scriptSource = readEntireFile(scriptPath, NULL);
+    if (!scriptSource) {
+        fprintf(stderr, ERROR "Could not read script file `%s`.\n", scriptPath);
+        return EXITCODE_COULD_NOT_READ_SCRIPT_SOURCE;
+    }
+    char *tempScriptPath = dupString(scriptPath);
+    scriptDir = dupString(dirname(tempScriptPath));
+    free(tempScriptPath);
+    tempScriptPath = dupString(scriptPath);
+    scriptModuleName = dupString(basename(tempScriptPath));
+    free(tempScriptPath);
+    size_t length = strlen(scriptModuleName);
+    if ((length >= 5) && (strcmp(&scriptModuleName[length - 5], ".wren") == 0)) {
+        scriptModuleName[length - 5] = 0;
+    }
+    if (moduleSearchPaths[0]) free(moduleSearchPaths[0]);
+    moduleSearchPaths[0] = dupString(scriptDir);
+    arguments[0] = scriptPath;
+    scriptArgv = arguments;
+    scriptArgc = count;
+    WrenInterpretResult result = wrenInterpret(vm, scriptModuleName, scriptSource);
+    if (result != WREN_RESULT_SUCCESS) fprintf(stderr, "%s", hostError(vm));
+    switch (result) {
+        case WREN_RESULT_SUCCESS:       return scriptExitCode;
+        case WREN_RESULT_COMPILE_ERROR: return EXITCODE_COMPILATION_ERROR;
+        case WREN_RESULT_RUNTIME_ERROR: return EXITCODE_RUNTIME_ERROR;
+    }
+    return EXITCODE_FATAL_ERROR;
+}
+
+// Imported by the daemon before it forks, so that every worker starts with them compiled.
+static const char *daemonModules[] = {
+    "std.assert", "std.buffer", "std.json", "std.string", "std.structures", "std.task",
+    "std.time", "std.io.fs", "std.os", NULL
+};
+
+static bool warmDaemonVM(void) {
+    Buffer source = {0};
+    for (const char **module = daemonModules; *module; module ++) {
+        pushBuffer(&source, "import \"");
+        pushBuffer(&source, *module);
+        pushBuffer(&source, "\"\n");
+    }
+    for (char *module = daemonPreload; module && *module; ) {
+        size_t length = strcspn(module, ",");
+        if (length > 0) {
+            pushBuffer(&source, "import \"");
+            pushBytesToBuffer(&source, module, length);
+            pushBuffer(&source, "\"\n");
+        }
+        module += length;
+        if (*module == ',') module ++;
+    }
+    WrenInterpretResult result = wrenInterpret(vm, "<daemon>", source.bytes);
+    finishBuffer(&source);
+    if (result != WREN_RESULT_SUCCESS) {
+        fprintf(stderr, "%s", hostError(vm));
+        return false;
+    }
+    return true;
+}
+
+int main(int argc_, char** argv_) {
+    enum {
+        OK,
+        INVALID_COMMAND_LINE_ARGS,
+        FATAL_ERROR,
+        COULD_NOT_READ_SCRIPT_SOURCE,
+        SCRIPT_COMPILATION_ERROR,
+        SCRIPT_RUNTIME_ERROR
     } status = OK;
     enum {
         RUN_SCRIPT,
         SHOW_HELP,
-        LIST_SEARCH_PATHS
+        LIST_SEARCH_PATHS,
+        BUILD_BUNDLE,
+        RUN_DAEMON
     } action = RUN_SCRIPT;
 
     argc = argc_;
     argv = argv_;
-    addModuleSearchPath(NULL);
-    if (status == OK) {
-        // Detect the binPath. Keep it NULL if this fails.
-        size_t capacity = 0;
-        ssize_t length = 0;
-        while ((status == OK) && (length >= capacity)) {
-            capacity = capacity ? capacity << 1 : 256;
-            binPath = realloc(binPath, capacity);
-            length = readlink("/proc/self/exe", binPath, capacity);
-            if (length < 0) {
-                fprintf(stderr, ERROR "Failed to read location of the GGWren executable "
-                        "readlink(..) failed.\n");
-                status = FATAL_ERROR;
-            }
-        }
-        if (status == OK) {
-            char *realBinPath = realpath(binPath, NULL);
-            if (realBinPath) {
-                free(binPath);
-                binPath = realBinPath;
-            } else {
-                fprintf(stderr, ERROR "Failed to read location of the GGWren executable "
-                        "realpath(..) failed.\n");
-                status = FATAL_ERROR;
-            }
-        } 
-        if (status != OK) {
-            if (binPath) free(binPath);
-            binPath = NULL;
+    if ((argc >= 2) && (strncmp(argv[1], "-client", 7) == 0) &&
+        ((argv[1][7] == 0) || (argv[1][7] == '=')))
+    {
+        // Hand everything to a warm daemon; nothing else about this process needs setting up.
+        const char *socketPath = argv[1][7] ? &argv[1][8] : getenv("GG_DAEMON_SOCKET");
+        if (!socketPath || !*socketPath || (argc < 3)) {
+            fprintf(stderr, ERROR "Usage: %s -client[=<socket>] <script> [<args>]\n"
+                    "Without =<socket>, the GG_DAEMON_SOCKET environment variable is used.\n",
+                    argv[0]);
+            return EXITCODE_INVALID_COMMAND_LINE_ARGS;
         }
+        int code = runClient(socketPath, argc - 2, &argv[2]);
+        return (code < 0) ? EXITCODE_FATAL_ERROR : code;
     }
-    if (binPath) {
-        char *tempBinPath = dupString(binPath);
-        binDir = dupString(dirname(tempBinPath));
-        free(tempBinPath);
+    int locateStep = beginStartupStep("locate executable");
+    addModuleSearchPath(NULL);
+    if (!locateExecutable()) status = FATAL_ERROR;
+    endStartupStep(locateStep);
+    int bundleStep = beginStartupStep("check for embedded bundle");
+    bool foundScriptPath = false;
+    if (binPath && loadBundle(binPath, true)) {
+        // This executable carries its own bundle, so every argument belongs to the script.
+        scriptPath = dupString(binPath);
+        scriptDir = dupString(binDir);
+        scriptArgv = argv;
+        scriptArgc = argc;
+        foundScriptPath = true;
     }
+    endStartupStep(bundleStep);
+    int argumentsStep = beginStartupStep("parse arguments");
     Buffer argKey = {0};
     Buffer argValue = {0};
-    bool foundScriptPath = false;
     for (size_t i = 1; (status == OK) && !foundScriptPath && (i < argc); i ++) {
         char* arg = argv[i];
         size_t argLength = strlen(arg);
@@ -740,6 +2339,177 @@ int main(int argc_, char** argv_) {
         }
         if (arg[0] == '-') {
             if      (strcmp(arg, "-list-lib-paths") == 0) action = LIST_SEARCH_PATHS;
+            else if (strcmp(arg, "-revalidate-module-index") == 0) revalidateModuleIndex = true;
+            else if (strcmp(arg, "-startup-profile") == 0) startupProfile = true;
+            else if (strcmp(arg, "-trace-foreign") == 0) traceForeign = true;
+            else if (strcmp(arg, "-bundle-exe") == 0) bundleExecutable = true;
+            else if (strcmp(arg, "-bundle-extensions") == 0) bundleExtensions = true;
+            else if (strcmp(argKey.bytes, "-alloc") == 0) {
+                if (argValueExists && (strcmp(argValue.bytes, "slab") == 0)) {
+                    allocatorKind = ALLOCATOR_SLAB;
+                } else if (argValueExists && (strcmp(argValue.bytes, "system") == 0)) {
+                    allocatorKind = ALLOCATOR_SYSTEM;
+                } else {
+                    fprintf(stderr, ERROR "The `-alloc` argument must be `slab` or `system`:\n\n");
+                    fprintf(stderr, "    %s -alloc=slab ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if ((strcmp(argKey.bytes, "-heap-initial") == 0) ||
+                     (strcmp(argKey.bytes, "-heap-min") == 0))
+            {
+                size_t size;
+                if (argValueExists && parseSize(argValue.bytes, &size) && (size > 0)) {
+                    if (strcmp(argKey.bytes, "-heap-initial") == 0) heapInitialSize = size;
+                    else heapMinSize = size;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a size with the `%s` argument:\n\n",
+                            argKey.bytes);
+                    fprintf(stderr, "    %s %s=16m ...\n\n", argv[0], argKey.bytes);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if ((strcmp(argKey.bytes, "-profile") == 0) && argValueExists) {
+                if (profilePath) free(profilePath);
+                profilePath = dupString(argValue.bytes);
+            }
+            else if (strcmp(argKey.bytes, "-profile-hz") == 0) {
+                size_t hz;
+                if (argValueExists && parseCount(argValue.bytes, &hz) && (hz > 0) &&
+                    (hz <= 10000))
+                {
+                    profileHz = (int)hz;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a rate between 1 and 10000 with the "
+                            "`-profile-hz` argument:\n\n");
+                    fprintf(stderr, "    %s -profile-hz=100 ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-workers") == 0) {
+                size_t count;
+                if (argValueExists && parseCount(argValue.bytes, &count) && (count > 0) &&
+                    (count <= 4096))
+                {
+                    workerCount = (int)count;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a worker count with the `-workers` "
+                            "argument:\n\n");
+                    fprintf(stderr, "    %s -workers=4 ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-work-threads") == 0) {
+                size_t count;
+                if (argValueExists && parseCount(argValue.bytes, &count) && (count > 0) &&
+                    (count <= 64))
+                {
+                    workThreads = (int)count;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a thread count from 1 to 64 with the "
+                            "`-work-threads` argument:\n\n");
+                    fprintf(stderr, "    %s -work-threads=4 ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-flush") == 0) {
+                // An interval is a plain count followed by "ms", which is stripped here.
+                size_t length = argValueExists ? strlen(argValue.bytes) : 0;
+                bool interval = (length > 2) && (strcmp(&argValue.bytes[length - 2], "ms") == 0);
+                if (interval) argValue.bytes[length - 2] = 0;
+                size_t ms;
+                if (!interval && argValueExists && (strcmp(argValue.bytes, "line") == 0)) {
+                    outputPolicy = OUTPUT_LINE;
+                } else if (!interval && argValueExists && (strcmp(argValue.bytes, "full") == 0)) {
+                    outputPolicy = OUTPUT_FULL;
+                } else if (interval && parseCount(argValue.bytes, &ms) && (ms > 0) &&
+                           (ms <= 60000))
+                {
+                    outputPolicy = OUTPUT_INTERVAL;
+                    outputIntervalMs = (int)ms;
+                } else {
+                    fprintf(stderr, ERROR "The `-flush` argument must be `line`, `full` or an "
+                            "interval from 1ms to 60000ms:\n\n");
+                    fprintf(stderr, "    %s -flush=50ms ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-metrics") == 0) {
+                const char *address = argValueExists ? (const char*)argValue.bytes : "";
+                char *end = NULL;
+                const char *port = strrchr(address, ':');
+                if ((strncmp(address, "tcp:", 4) == 0) && port) strtol(&port[1], &end, 10);
+                if (((strncmp(address, "unix:", 5) == 0) && address[5]) ||
+                    (end && (end != &port[1]) && !*end))
+                {
+                    if (metricsAddress) free(metricsAddress);
+                    metricsAddress = dupString(address);
+                } else {
+                    fprintf(stderr, ERROR "The `-metrics` argument must be `unix:<path>` or "
+                            "`tcp:[<host>:]<port>`:\n\n");
+                    fprintf(stderr, "    %s -metrics=tcp:9100 ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-output-buffer") == 0) {
+                size_t size;
+                if (argValueExists && parseSize(argValue.bytes, &size) && (size >= 256)) {
+                    outputBufferSize = size;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a size of at least 256 bytes with the "
+                            "`-output-buffer` argument:\n\n");
+                    fprintf(stderr, "    %s -output-buffer=1m ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if (strcmp(argKey.bytes, "-heap-growth") == 0) {
+                size_t percent;
+                if (argValueExists && parseCount(argValue.bytes, &percent) && (percent > 0) &&
+                    (percent <= 10000))
+                {
+                    heapGrowthPercent = (int)percent;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a percentage with the `-heap-growth` "
+                            "argument:\n\n");
+                    fprintf(stderr, "    %s -heap-growth=50 ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
+            else if ((strcmp(argKey.bytes, "-daemon") == 0) && argValueExists) {
+                if (daemonPath) free(daemonPath);
+                daemonPath = dupString(argValue.bytes);
+                action = RUN_DAEMON;
+            }
+            else if ((strcmp(argKey.bytes, "-preload") == 0) && argValueExists) {
+                if (daemonPreload) free(daemonPreload);
+                daemonPreload = dupString(argValue.bytes);
+            }
+            else if ((strcmp(argKey.bytes, "-bundle") == 0) && argValueExists) {
+                if (bundlePath) free(bundlePath);
+                bundlePath = dupString(argValue.bytes);
+                action = BUILD_BUNDLE;
+            } else if (strcmp(argKey.bytes, "-run-bundle") == 0) {
+                if (argValueExists && loadBundle(argValue.bytes, false)) {
+                    scriptPath = realpath(argValue.bytes, NULL);
+                    if (!scriptPath) scriptPath = dupString(argValue.bytes);
+                    char *tempScriptPath = dupString(scriptPath);
+                    scriptDir = dupString(dirname(tempScriptPath));
+                    free(tempScriptPath);
+                    argv[i] = scriptPath;
+                    scriptArgv = &argv[i];
+                    scriptArgc = argc - i;
+                    foundScriptPath = true;
+                } else if (argValueExists) {
+                    fprintf(stderr, ERROR "`%s` is not a readable GGWren bundle.\n",
+                            argValue.bytes);
+                    status = COULD_NOT_READ_SCRIPT_SOURCE;
+                } else {
+                    fprintf(stderr, ERROR "You must supply a path with the `-run-bundle` "
+                            "argument:\n\n");
+                    fprintf(stderr, "    %s -run-bundle=<path> ...\n\n", argv[0]);
+                    status = INVALID_COMMAND_LINE_ARGS;
+                }
+            }
             else if (strcmp(argKey.bytes, "-lib") == 0) {
                 if (argValueExists) {
                     char *searchPath = realpath(argValue.bytes, NULL);
@@ -775,7 +2545,21 @@ int main(int argc_, char** argv_) {
     }
     finishBuffer(&argKey);
     finishBuffer(&argValue);
-    if ((status == OK) && (action == RUN_SCRIPT)) {
+    endStartupStep(argumentsStep);
+    if (startupProfile && (action == RUN_SCRIPT)) {
+        atexit(&printStartupSteps);
+    } else {
+        for (int i = 0; i < startupStepCount; i ++) free(startupSteps[i].label);
+        free(startupSteps);
+        startupSteps = NULL;
+        startupStepCount = startupStepCapacity = 0;
+        startupRecording = false;
+    }
+    int scriptStep = beginStartupStep("read main script");
+    if ((status == OK) && (action == RUN_SCRIPT) && bundleMain) {
+        scriptSource = (char*)bundleData(bundleMain);
+        scriptModuleName = dupString((const char*)(&bundleBase[bundleMain->nameOffset]));
+    } else if ((status == OK) && ((action == RUN_SCRIPT) || (action == BUILD_BUNDLE))) {
         if (scriptPath) {       
             scriptSource = readEntireFile(scriptPath, NULL);
             char* tempScriptPath = dupString(scriptPath);
@@ -796,71 +2580,35 @@ int main(int argc_, char** argv_) {
             status = INVALID_COMMAND_LINE_ARGS;
         }
     }
+    endStartupStep(scriptStep);
+    int searchPathStep = beginStartupStep("set up module search paths");
     if (scriptDir) moduleSearchPaths[0] = dupString(scriptDir);
-    char *libDir = xsprintf("%s/lib", binDir);
-    if (binDir) addModuleSearchPath(libDir);
-    free(libDir);
-    if (getenv("GG_LIB")) {
-        int start = 0;
-        char *lib = getenv("GG_LIB");
-        for (int index = 0; lib[index]; index ++) {
-            if (lib[index] == ':') {
-                int length = index - start;
-                if (length) {
-                    char* path = malloc(length + 1);
-                    memcpy(path, &lib[start], length);
-                    path[length] = 0;
-                    addModuleSearchPath(path);
-                    free(path);
-                }
-                start = index + 1;
-            }
-        }
-        int length = strlen(lib) - start;
-        if (length) {
-            char* path = malloc(length + 1);
-            memcpy(path, &lib[start], length);
-            path[length] = 0;
-            addModuleSearchPath(path);
-            free(path);
-        }
-    }
-    addModuleSearchPath("/usr/lib/ggwren");
-    if (tooManyModuleSearchPaths) {
-        fprintf(stderr, "\x1b[33;1m[WARNING]\x1b[m ");
-        fprintf(stderr, "Too many module search paths were added (the limit is %d); the extras\n"
-                "were ignored.\n", MAX_MODULE_SEARCH_PATHS);
-    }
-    {
-        Ext* ext = malloc(sizeof(Ext));
-        ext->name = dupString("builtins");
-        ext->handle = NULL;
-        ext->classes = NULL;
-        ext->methods = NULL;
-        ext->next = extensions;
-        extensions = ext;
-        extBeingInitialized = ext;
-        initBuiltins();
-        extBeingInitialized = NULL;
-    }
+    addDefaultSearchPaths();
+    endStartupStep(searchPathStep);
+    int builtinsStep = beginStartupStep("register builtins");
+    registerBuiltins();
+    endStartupStep(builtinsStep);
     switch (action) {
         case RUN_SCRIPT: if (status == OK) {
-            wrenInitConfiguration(&config);
-            config.writeFn = &apiConfig_write;
-            config.readFn = &apiConfig_input;
-            config.errorFn = &apiConfig_error;
-            config.bindForeignMethodFn = &apiConfig_bindForeignMethod;
-            config.bindForeignClassFn = &apiConfig_bindForeignClass;
-            config.loadModuleFn = &apiConfig_loadModule;
-            config.resolveModuleFn = &apiConfig_resolveModule;
-            vm = wrenNewVM(&config);
+            if (traceForeign) atexit(&dumpForeignStats);
+            int vmStep = beginStartupStep("create VM");
+            vm = newHostVM(NULL);
+            endStartupStep(vmStep);
+            const char *profileError;
+            if (profilePath && !startProfiler(vm, profilePath, profileHz, &profileError)) {
+                fprintf(stderr, ERROR "%s\n", profileError);
+                status = FATAL_ERROR;
+                break;
+            }
+            int runStep = beginStartupStep("run %s", scriptModuleName);
             WrenInterpretResult result = wrenInterpret(
                 vm,
                 scriptModuleName,
                 scriptSource
             );
+            endStartupStep(runStep);
             if (result != WREN_RESULT_SUCCESS) {
-                fprintf(stderr, "%s", fullError.bytes);
+                fprintf(stderr, "%s", hostError(vm));
             }
             switch (result) {
                 case WREN_RESULT_SUCCESS: { status = OK; } break;
@@ -868,6 +2616,21 @@ int main(int argc_, char** argv_) {
                 case WREN_RESULT_RUNTIME_ERROR: { status = SCRIPT_RUNTIME_ERROR; } break;
             }
         } break;
+        case RUN_DAEMON: if (status == OK) {
+            vm = newHostVM(NULL);
+            if (!warmDaemonVM()) {
+                status = FATAL_ERROR;
+                break;
+            }
+            flushOutput();
+            fflush(stdout);
+            fflush(stderr);
+            int workers = (workerCount > 0) ? workerCount : 4;
+            if (runDaemon(daemonPath, workers, &runDaemonScript) < 0) status = FATAL_ERROR;
+        } break;
+        case BUILD_BUNDLE: if (status == OK) {
+            if (!writeBundle(bundlePath, bundleExecutable)) status = FATAL_ERROR;
+        } break;
         case SHOW_HELP: {
             fprintf(stderr, HELP, argv[0]);
         } break;
@@ -884,42 +2647,28 @@ int main(int argc_, char** argv_) {
             fprintf(stderr, "\n");
         } break;
     }
-    if (vm) wrenFreeVM(vm);
-    Ext* nextExt;
-    for (Ext *ext = extensions; ext; ext = nextExt) {
-        if (ext->handle) {
-            ggExt_FinishFn extFinish = getExtFn(ext->handle, "ggExt_finish");
-            if (extFinish) extFinish();
-            closeExt(ext->handle);
-        }
-        ExtClass* nextClass;
-        for (ExtClass *class = ext->classes; class; class = nextClass) {
-            nextClass = class->next;
-            free(class);
-        }
-        ExtMethod* nextMethod;
-        for (ExtMethod *method = ext->methods; method; method = nextMethod) {
-            nextMethod = method->next;
-            free(method);
-        }
-        nextExt = ext->next;
-        free(ext->name);
-        free(ext);
-    }
-    for (size_t i = 0; i < moduleSearchPathCount; i ++) {
-        free(moduleSearchPaths[i]);
+    if (vm && startupProfile) {
+        VMContext *ctx = wrenGetUserData(vm);
+        fprintf(stderr, NOTE "Bound %d foreign method%s in %.3f ms and %d foreign class%s in "
+                "%.3f ms.\n", ctx->methodsBound, ctx->methodsBound != 1 ? "s" : "",
+                ctx->methodBindNanoseconds / 1000000.0, ctx->classesBound,
+                ctx->classesBound != 1 ? "es" : "", ctx->classBindNanoseconds / 1000000.0);
     }
-    if (binPath) free(binPath);
-    if (binDir) free(binDir);
+    stopProfiler();
+    if (vm) freeHostVM(vm);
+    finishHost();
     if (scriptPath) free(scriptPath);
-    if (scriptSource) free(scriptSource);
+    if (scriptSource && !bundleMain) free(scriptSource);
+    if (bundlePath) free(bundlePath);
+    if (profilePath) free(profilePath);
+    if (daemonPath) free(daemonPath);
+    if (daemonPreload) free(daemonPreload);
+    if (metricsAddress) free(metricsAddress);
+    finishTable(&bundleModules, NULL);
+    finishTable(&bundleExtensionTable, NULL);
+    if (bundleMap) munmap(bundleMap, bundleMapSize);
     if (scriptModuleName) free(scriptModuleName);
     if (scriptDir) free(scriptDir);
-    finishBuffer(&foreignMethodSignature);
-    finishBuffer(&modulePath);
-    finishBuffer(&moduleNameTemp);
-    if (preboundModuleName) free(preboundModuleName);
-    if (preboundModuleSource) free(preboundModuleSource);
     switch (status) {
         case OK:                            return scriptExitCode;
         case SCRIPT_RUNTIME_ERROR:          return EXITCODE_RUNTIME_ERROR;
@@ -929,3 +2678,4 @@ int main(int argc_, char** argv_) {
         case FATAL_ERROR:                   return EXITCODE_FATAL_ERROR;
     }
 }
+#endif
@@ -0,0 +1,439 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// Runtime metrics for `-metrics=<address>` (see std.metrics). Scripts register counters and
+// gauges here by name; a scrape renders them, along with the host's own figures, in the
+// Prometheus text format into one buffer that is kept between scrapes, so a scrape doesn't
+// allocate once the buffer has grown to fit. Registration and updates are locked, since
+// isolates share the registry.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+#ifdef GG_WREN_INTERNALS
+#include <wren_vm.h>
+#endif
+
+// Platform-specific includes
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#include "gg.h"
+
+#define MAX_METRICS 256
+#define MAX_MODULE_LOADS 256
+#define MAX_FOREIGN_CLASSES 64
+#define MAX_MODULE_NAME 64
+#define METRICS_HEADER_SPACE 128
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE
+} MetricKind;
+
+typedef struct Metric Metric;
+struct Metric {
+    char *name;
+    char *help;
+    MetricKind kind;
+    double value;
+};
+
+typedef struct ModuleLoad ModuleLoad;
+struct ModuleLoad {
+    char name[MAX_MODULE_NAME];
+    double seconds;
+};
+
+char *metricsAddress = NULL;
+
+static Metric metrics[MAX_METRICS];
+static int metricCount = 0;
+static ModuleLoad moduleLoads[MAX_MODULE_LOADS];
+static int moduleLoadCount = 0;
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Reported by the scraping TaskQueue through Metrics.setRuntime_(..).
+static double runtimeTasks = 0;
+static double runtimeLag = 0;
+
+// The response being sent. The body is rendered after METRICS_HEADER_SPACE bytes so that the
+// HTTP header, whose length depends on the body's, can be put right in front of it.
+static char *responseText = NULL;
+static size_t responseCapacity = 0;
+static size_t responseStart = 0;
+static size_t responseEnd = 0;
+static char requestTail[4];  // The last bytes of the request read so far, to spot its end.
+
+/**************************************************************************************************/
+
+void recordModuleLoad(const char *name, uint64_t nanoseconds) {
+    pthread_mutex_lock(&metricsLock);
+    if (moduleLoadCount < MAX_MODULE_LOADS) {
+        ModuleLoad *load = &moduleLoads[moduleLoadCount ++];
+        snprintf(load->name, sizeof(load->name), "%s", name);
+        load->seconds = nanoseconds / 1e9;
+    }
+    pthread_mutex_unlock(&metricsLock);
+}
+
+static void appendResponse(const char *format, ...) {
+    for (;;) {
+        size_t space = responseCapacity - responseEnd;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(&responseText[responseEnd], space, format, args);
+        va_end(args);
+        if (length < 0) return;
+        if ((size_t)length < space) {
+            responseEnd += length;
+            return;
+        }
+        responseCapacity = (responseCapacity + length) * 2;
+        responseText = realloc(responseText, responseCapacity);
+    }
+}
+
+static void appendMetricHeader(const char *name, const char *type, const char *help) {
+    appendResponse("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Label values may hold any printable character; `\` and `"` must be escaped.
+static void appendLabelValue(const char *value) {
+    for (const char *c = value; *c; c ++) {
+        if ((*c == '\\') || (*c == '"')) appendResponse("\\%c", *c);
+        else appendResponse("%c", *c);
+    }
+}
+
+// Counted straight from the kernel's directory records, since opendir(..) would allocate.
+static int countOpenFds(void) {
+    int dir = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) return -1;
+    char records[4096] __attribute__((aligned(8)));
+    int count = 0;
+    for (;;) {
+        long size = syscall(SYS_getdents64, dir, records, sizeof(records));
+        if (size <= 0) break;
+        for (long offset = 0; offset < size; ) {
+            // struct linux_dirent64: d_ino, d_off, d_reclen, d_type, d_name.
+            unsigned short length;
+            memcpy(&length, &records[offset + 16], sizeof(length));
+            if (records[offset + 19] != '.') count ++;
+            offset += length;
+        }
+    }
+    (void)close(dir);
+    return count - 1; // Not counting `dir` itself.
+}
+
+#ifdef GG_WREN_INTERNALS
+static void appendForeignObjects(WrenVM *vm) {
+    static ObjClass *classes[MAX_FOREIGN_CLASSES];
+    static int counts[MAX_FOREIGN_CLASSES];
+    int classCount = 0;
+    int others = 0;
+    for (Obj *obj = vm->first; obj; obj = obj->next) {
+        if (obj->type != OBJ_FOREIGN) continue;
+        int i = 0;
+        while ((i < classCount) && (classes[i] != obj->classObj)) i ++;
+        if (i == classCount) {
+            if (classCount == MAX_FOREIGN_CLASSES) {
+                others ++;
+                continue;
+            }
+            classes[classCount] = obj->classObj;
+            counts[classCount ++] = 0;
+        }
+        counts[i] ++;
+    }
+    appendMetricHeader("gg_foreign_objects", "gauge", "Live foreign objects, by class.");
+    for (int i = 0; i < classCount; i ++) {
+        appendResponse("gg_foreign_objects{class=\"");
+        appendLabelValue(classes[i]->name->value);
+        appendResponse("\"} %d\n", counts[i]);
+    }
+    if (others) appendResponse("gg_foreign_objects{class=\"(other)\"} %d\n", others);
+}
+#endif
+
+static void renderMetrics(WrenVM *vm) {
+    if (!responseText) {
+        responseCapacity = 16 * 1024;
+        responseText = malloc(responseCapacity);
+    }
+    responseEnd = METRICS_HEADER_SPACE;
+
+    const Allocator *allocator = hostAllocator(vm);
+    int collections;
+    uint64_t pauseNanoseconds;
+    hostGcStats(vm, &collections, &pauseNanoseconds);
+    appendMetricHeader("gg_heap_live_bytes", "gauge", "Bytes of Wren heap in use.");
+    appendResponse("gg_heap_live_bytes %zu\n", allocator->liveBytes);
+    appendMetricHeader("gg_heap_peak_bytes", "gauge", "Most bytes of Wren heap ever in use.");
+    appendResponse("gg_heap_peak_bytes %zu\n", allocator->peakBytes);
+    appendMetricHeader("gg_heap_reserved_bytes", "gauge", "Bytes reserved by the slab allocator.");
+    appendResponse("gg_heap_reserved_bytes %zu\n", allocator->reservedBytes);
+    appendMetricHeader("gg_heap_allocations_total", "counter", "Wren heap allocations.");
+    appendResponse("gg_heap_allocations_total %llu\n",
+            (unsigned long long)allocator->allocations);
+#ifdef GG_WREN_INTERNALS
+    appendMetricHeader("gg_heap_next_gc_bytes", "gauge",
+            "Heap size at which Wren collects next.");
+    appendResponse("gg_heap_next_gc_bytes %zu\n", vm->nextGC);
+#endif
+    // Wren doesn't report the collections it schedules itself, so only GG.collect() is counted.
+    appendMetricHeader("gg_gc_manual_collections_total", "counter",
+            "Collections run by GG.collect().");
+    appendResponse("gg_gc_manual_collections_total %d\n", collections);
+    appendMetricHeader("gg_gc_manual_pause_seconds_total", "counter",
+            "Time spent in collections run by GG.collect().");
+    appendResponse("gg_gc_manual_pause_seconds_total %.9f\n", pauseNanoseconds / 1e9);
+#ifdef GG_WREN_INTERNALS
+    appendForeignObjects(vm);
+#endif
+    appendMetricHeader("gg_open_fds", "gauge", "Open file descriptors.");
+    appendResponse("gg_open_fds %d\n", countOpenFds());
+    appendMetricHeader("gg_tasks", "gauge", "Tasks in the scraping TaskQueue.");
+    appendResponse("gg_tasks %.17g\n", runtimeTasks);
+    appendMetricHeader("gg_scheduler_lag_seconds", "gauge",
+            "How late the scraping TaskQueue last woke a sleeping task.");
+    appendResponse("gg_scheduler_lag_seconds %.9f\n", runtimeLag);
+
+    pthread_mutex_lock(&metricsLock);
+    appendMetricHeader("gg_module_load_seconds", "gauge",
+            "Time to find and compile each module.");
+    for (int i = 0; i < moduleLoadCount; i ++) {
+        appendResponse("gg_module_load_seconds{module=\"");
+        appendLabelValue(moduleLoads[i].name);
+        appendResponse("\"} %.9f\n", moduleLoads[i].seconds);
+    }
+    for (int i = 0; i < metricCount; i ++) {
+        Metric *metric = &metrics[i];
+        appendMetricHeader(metric->name, (metric->kind == METRIC_COUNTER) ? "counter" : "gauge",
+                metric->help);
+        appendResponse("%s %.17g\n", metric->name, metric->value);
+    }
+    pthread_mutex_unlock(&metricsLock);
+
+    char header[METRICS_HEADER_SPACE];
+    int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\n\r\n", responseEnd - METRICS_HEADER_SPACE);
+    responseStart = METRICS_HEADER_SPACE - headerLength;
+    memcpy(&responseText[responseStart], header, headerLength);
+}
+
+/**************************************************************************************************/
+
+// Only the main VM serves metrics; isolates see null here. GG.metricsAddress is the same, so
+// that std.task can skip importing std.metrics when nothing is served.
+static
+void apiStatic_Metrics_address_getter(WrenVM *vm) {
+    if (metricsAddress && !hostIsolate(vm)) wrenSetSlotString(vm, 0, metricsAddress);
+    else wrenSetSlotNull(vm, 0);
+}
+
+void apiStatic_GG_metricsAddress_getter(WrenVM *vm) {
+    apiStatic_Metrics_address_getter(vm);
+}
+
+static bool isValidMetricName(const char *name) {
+    if (!*name || ((*name >= '0') && (*name <= '9'))) return false;
+    for (const char *c = name; *c; c ++) {
+        if (!(((*c >= 'a') && (*c <= 'z')) || ((*c >= 'A') && (*c <= 'Z')) ||
+              ((*c >= '0') && (*c <= '9')) || (*c == '_') || (*c == ':')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Metrics.register_(kind, name, help) returns the metric's id. Registering a name again (from
+// another isolate, say) returns the same id, as long as the kind matches.
+static
+void apiStatic_Metrics_register_3(WrenVM *vm) {
+    MetricKind kind = (MetricKind)wrenGetSlotDouble(vm, 1);
+    const char *name = wrenGetSlotString(vm, 2);
+    const char *help = wrenGetSlotString(vm, 3);
+    if (!isValidMetricName(name)) {
+        wrenSetSlotString(vm, 0, "Metric names must match [a-zA-Z_:][a-zA-Z0-9_:]*.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    const char *error = NULL;
+    int id = -1;
+    pthread_mutex_lock(&metricsLock);
+    for (int i = 0; i < metricCount; i ++) {
+        if (strcmp(metrics[i].name, name) == 0) {
+            id = i;
+            if (metrics[i].kind != kind) error = "A metric with this name but another kind exists.";
+        }
+    }
+    if ((id < 0) && (metricCount == MAX_METRICS)) {
+        error = "Too many metrics have been registered.";
+    } else if (id < 0) {
+        id = metricCount ++;
+        metrics[id].name = strdup(name);
+        metrics[id].help = strdup(help);
+        for (char *c = metrics[id].help; *c; c ++) {
+            if (*c == '\n') *c = ' ';
+        }
+        metrics[id].kind = kind;
+        metrics[id].value = 0;
+    }
+    pthread_mutex_unlock(&metricsLock);
+    if (error) {
+        wrenSetSlotString(vm, 0, error);
+        wrenAbortFiber(vm, 0);
+    } else {
+        wrenSetSlotDouble(vm, 0, id);
+    }
+}
+
+static
+void apiStatic_Metrics_add_2(WrenVM *vm) {
+    int id = (int)wrenGetSlotDouble(vm, 1);
+    double delta = wrenGetSlotDouble(vm, 2);
+    pthread_mutex_lock(&metricsLock);
+    if ((id >= 0) && (id < metricCount)) metrics[id].value += delta;
+    pthread_mutex_unlock(&metricsLock);
+    wrenSetSlotNull(vm, 0);
+}
+
+static
+void apiStatic_Metrics_set_2(WrenVM *vm) {
+    int id = (int)wrenGetSlotDouble(vm, 1);
+    double value = wrenGetSlotDouble(vm, 2);
+    pthread_mutex_lock(&metricsLock);
+    if ((id >= 0) && (id < metricCount)) metrics[id].value = value;
+    pthread_mutex_unlock(&metricsLock);
+    wrenSetSlotNull(vm, 0);
+}
+
+static
+void apiStatic_Metrics_value_1(WrenVM *vm) {
+    int id = (int)wrenGetSlotDouble(vm, 1);
+    double value = 0;
+    pthread_mutex_lock(&metricsLock);
+    if ((id >= 0) && (id < metricCount)) value = metrics[id].value;
+    pthread_mutex_unlock(&metricsLock);
+    wrenSetSlotDouble(vm, 0, value);
+}
+
+static
+void apiStatic_Metrics_setRuntime_2(WrenVM *vm) {
+    runtimeTasks = wrenGetSlotDouble(vm, 1);
+    runtimeLag = wrenGetSlotDouble(vm, 2);
+    wrenSetSlotNull(vm, 0);
+}
+
+// Metrics.readRequest_(fd) reads (and ignores) as much of a request as is available. Returns
+// true once the blank line ending the request headers, or the end of the stream, has been seen.
+static
+void apiStatic_Metrics_readRequest_1(WrenVM *vm) {
+    int fd = (int)wrenGetSlotDouble(vm, 1);
+    char bytes[1024];
+    for (;;) {
+        ssize_t count = read(fd, bytes, sizeof(bytes));
+        if ((count < 0) && (errno == EINTR)) continue;
+        if (count == 0) {
+            wrenSetSlotBool(vm, 0, true);
+            return;
+        }
+        if (count < 0) {
+            // A broken connection is handled like a finished one; sending will fail too.
+            wrenSetSlotBool(vm, 0, (errno != EAGAIN) && (errno != EWOULDBLOCK));
+            return;
+        }
+        for (ssize_t i = 0; i < count; i ++) {
+            memmove(requestTail, &requestTail[1], 3);
+            requestTail[3] = bytes[i];
+            if ((memcmp(requestTail, "\r\n\r\n", 4) == 0) ||
+                (memcmp(&requestTail[2], "\n\n", 2) == 0))
+            {
+                wrenSetSlotBool(vm, 0, true);
+                return;
+            }
+        }
+    }
+}
+
+// Metrics.render_() renders a fresh response for the connection about to be served and returns
+// its length in bytes.
+static
+void apiStatic_Metrics_render_0(WrenVM *vm) {
+    memset(requestTail, 0, sizeof(requestTail));
+    renderMetrics(vm);
+    wrenSetSlotDouble(vm, 0, (double)(responseEnd - responseStart));
+}
+
+// Metrics.send_(fd, offset) writes as much of the response from `offset` on as `fd` will take.
+// Returns the number of bytes written, 0 if `fd` would block, or -1 if the connection is gone.
+static
+void apiStatic_Metrics_send_2(WrenVM *vm) {
+    int fd = (int)wrenGetSlotDouble(vm, 1);
+    size_t offset = (size_t)wrenGetSlotDouble(vm, 2);
+    size_t size = responseEnd - responseStart;
+    if (offset >= size) {
+        wrenSetSlotDouble(vm, 0, 0);
+        return;
+    }
+    ssize_t count;
+    do {
+        count = send(fd, &responseText[responseStart + offset], size - offset, MSG_NOSIGNAL);
+    } while ((count < 0) && (errno == EINTR));
+    if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) count = 0;
+    wrenSetSlotDouble(vm, 0, (count < 0) ? -1 : (double)count);
+}
+
+void initMetrics(void) {
+    ggRegisterMethod("Metrics", "static address", &apiStatic_Metrics_address_getter);
+    ggRegisterMethod("Metrics", "static register_(_,_,_)", &apiStatic_Metrics_register_3);
+    ggRegisterMethod("Metrics", "static add_(_,_)", &apiStatic_Metrics_add_2);
+    ggRegisterMethod("Metrics", "static set_(_,_)", &apiStatic_Metrics_set_2);
+    ggRegisterMethod("Metrics", "static value_(_)", &apiStatic_Metrics_value_1);
+    ggRegisterMethod("Metrics", "static setRuntime_(_,_)", &apiStatic_Metrics_setRuntime_2);
+    ggRegisterMethod("Metrics", "static readRequest_(_)", &apiStatic_Metrics_readRequest_1);
+    ggRegisterMethod("Metrics", "static render_()", &apiStatic_Metrics_render_0);
+    ggRegisterMethod("Metrics", "static send_(_,_)", &apiStatic_Metrics_send_2);
+}
@@ -0,0 +1,195 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// Everything Wren prints (System.print, System.write) goes through one process-wide buffer and
+// reaches stdout as a single write(2) per batch. When a batch is written depends on the policy:
+//
+//  - OUTPUT_LINE: after any write containing a newline (the default on a terminal).
+//  - OUTPUT_FULL: only when the buffer fills (the default otherwise).
+//  - OUTPUT_INTERVAL: when the buffer fills, or `outputIntervalMs` after the oldest unwritten
+//    byte; a helper thread makes sure that happens even while the script is idle.
+//
+// Whatever the policy, the buffer is also written by GG.flush(), at exit, before a fork, before
+// reading from stdin or running Process.system(..), and before an error is printed to stderr.
+// Isolates print from their own threads, so the buffer is guarded by `outputLock`.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <wren.h>
+
+// Platform-specific includes
+#ifdef __linux__
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#include "gg.h"
+
+OutputPolicy outputPolicy = OUTPUT_DEFAULT;
+size_t outputBufferSize = 64 * 1024;
+int outputIntervalMs = 50;
+
+static char *outputBuffer = NULL;
+static size_t outputCount = 0;
+static uint64_t outputOldest = 0; // When the first byte now in the buffer was written (ns).
+static bool outputFlusherStarted = false;
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t outputPending;
+
+// CLOCK_MONOTONIC rather than monotonicNanoseconds()'s raw clock, to match `outputPending`.
+static uint64_t outputNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void writeAllOutput(const char *bytes, size_t size) {
+    while (size > 0) {
+        ssize_t count = write(STDOUT_FILENO, bytes, size);
+        if ((count < 0) && (errno == EINTR)) continue;
+        if (count <= 0) return; // Nowhere to report this; the output is lost either way.
+        bytes += count;
+        size -= count;
+    }
+}
+
+// Must hold `outputLock`.
+static void flushOutputLocked(void) {
+    if (outputCount == 0) return;
+    writeAllOutput(outputBuffer, outputCount);
+    outputCount = 0;
+}
+
+static void* outputFlusher(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&outputLock);
+    for (;;) {
+        while (outputCount == 0) pthread_cond_wait(&outputPending, &outputLock);
+        uint64_t due = outputOldest + (uint64_t)outputIntervalMs * 1000000ull;
+        struct timespec deadline = {
+            .tv_sec = due / 1000000000ull,
+            .tv_nsec = due % 1000000000ull
+        };
+        int result = 0;
+        while ((outputCount > 0) && (result != ETIMEDOUT)) {
+            result = pthread_cond_timedwait(&outputPending, &outputLock, &deadline);
+        }
+        if ((outputCount > 0) && (outputNow() >= due)) flushOutputLocked();
+    }
+    return NULL;
+}
+
+// Must hold `outputLock`.
+static void startOutputFlusher(void) {
+    if (outputFlusherStarted) return;
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&outputPending, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &outputFlusher, NULL) == 0) {
+        pthread_detach(thread);
+        outputFlusherStarted = true;
+    } else {
+        outputPolicy = OUTPUT_FULL;
+    }
+}
+
+void writeOutput(const char *text, size_t length) {
+    pthread_mutex_lock(&outputLock);
+    if (outputPolicy == OUTPUT_DEFAULT) {
+        // Decided on first use rather than at startup, since a -daemon worker is handed its
+        // stdout after the host starts.
+        outputPolicy = isatty(STDOUT_FILENO) ? OUTPUT_LINE : OUTPUT_FULL;
+    }
+    if (!outputBuffer) outputBuffer = malloc(outputBufferSize);
+    if (outputCount + length > outputBufferSize) flushOutputLocked();
+    if (length >= outputBufferSize) {
+        writeAllOutput(text, length);
+    } else {
+        if ((outputCount == 0) && (outputPolicy == OUTPUT_INTERVAL)) {
+            outputOldest = outputNow();
+            startOutputFlusher();
+            pthread_cond_signal(&outputPending);
+        }
+        memcpy(&outputBuffer[outputCount], text, length);
+        outputCount += length;
+        if ((outputPolicy == OUTPUT_LINE) && memchr(text, '\n', length)) flushOutputLocked();
+    }
+    pthread_mutex_unlock(&outputLock);
+}
+
+void flushOutput(void) {
+    pthread_mutex_lock(&outputLock);
+    flushOutputLocked();
+    pthread_mutex_unlock(&outputLock);
+}
+
+// The flusher thread doesn't survive fork(), and may be holding the lock when it happens; the
+// buffer is written first so that neither process writes it again.
+static void outputPrepareFork(void) {
+    pthread_mutex_lock(&outputLock);
+    flushOutputLocked();
+}
+
+static void outputParentFork(void) {
+    pthread_mutex_unlock(&outputLock);
+}
+
+static void outputChildFork(void) {
+    if (outputFlusherStarted) {
+        outputFlusherStarted = false;
+        pthread_cond_destroy(&outputPending);
+    }
+    pthread_mutex_unlock(&outputLock);
+}
+
+static void flushOutputAtExit(void) {
+    flushOutput();
+}
+
+void initOutput(void) {
+    static bool initialized = false;
+    if (initialized) return;
+    initialized = true;
+    pthread_atfork(&outputPrepareFork, &outputParentFork, &outputChildFork);
+    atexit(&flushOutputAtExit);
+}
+
+void apiStatic_GG_flush_0(WrenVM *vm) {
+    flushOutput();
+    wrenSetSlotNull(vm, 0);
+}
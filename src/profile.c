@@ -0,0 +1,362 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// The -profile sampler. A per-thread CPU-time timer delivers SIGPROF to the main VM's thread;
+// the handler walks the running fiber (and the fibers that called it) and counts the stack in
+// tables allocated up front, so nothing in the handler allocates or locks. At exit the counts
+// are written in the folded format understood by flamegraph.pl and speedscope:
+//
+//     main (main:12);Task.resume() (std.task:140);run() (server:31) 57
+//
+// Lines are approximate for the innermost frame. Wren keeps the running frame's instruction
+// pointer in a local and only writes it back to the frame when it makes a call. So that frame's
+// line is wherever it last called from, and a frame that hasn't called anything yet is counted
+// against its function with line `?`.
+//
+// Walking a fiber needs Wren's private headers, so this only works in builds compiled with
+// GG_WREN_INTERNALS and Wren's src/vm directory on the include path (see INSTALL.md).
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+// Platform-specific includes
+#ifdef __linux__
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#ifdef GG_WREN_INTERNALS
+#include <wren_vm.h>
+#endif
+
+// Older glibc headers don't name this field.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#include "gg.h"
+
+#ifdef GG_WREN_INTERNALS
+
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_FRAME_CAPACITY 8192      // Distinct (function, line) pairs; a power of two.
+#define PROFILE_NAME_ARENA (512 * 1024)
+#define PROFILE_STACK_CAPACITY 32768     // Distinct stacks; a power of two.
+#define PROFILE_STACK_ARENA (2 * 1024 * 1024)
+
+typedef struct ProfileFrame ProfileFrame;
+struct ProfileFrame {
+    const void *fn;
+    int line;
+    uint32_t name;      // Offset of "function (module:line)" in profileNames.
+};
+
+typedef struct ProfileStack ProfileStack;
+struct ProfileStack {
+    uint64_t hash;
+    uint32_t frames;    // Offset of the frame ids in profileStackFrames, root first.
+    uint32_t depth;
+    uint64_t samples;
+};
+
+static WrenVM *profiledVM = NULL;
+static char *profilePath = NULL;
+static pid_t profilePid = 0;
+static timer_t profileTimer;
+static bool profileTimerArmed = false;
+static long profileInterval = 0;
+
+static ProfileFrame *profileFrames = NULL;
+static uint32_t profileFrameCount = 0;
+static char *profileNames = NULL;
+static uint32_t profileNamesUsed = 0;
+static ProfileStack *profileStacks = NULL;
+static uint32_t profileStackCount = 0;
+static uint32_t *profileStackFrames = NULL;
+static uint32_t profileStackFramesUsed = 0;
+static volatile uint64_t profileSamples = 0;
+static volatile uint64_t profileDropped = 0;
+
+static uint32_t appendName(const char *text, size_t length) {
+    if (profileNamesUsed + length + 1 > PROFILE_NAME_ARENA) return UINT32_MAX;
+    uint32_t offset = profileNamesUsed;
+    memcpy(&profileNames[offset], text, length);
+    profileNamesUsed += length;
+    profileNames[profileNamesUsed ++] = 0;
+    return offset;
+}
+
+// Formats "function (module:line)" without stdio, which isn't async-signal-safe. A `line` of -1
+// (unknown) is written as "?".
+static uint32_t internFrame(ObjFn *fn, int line) {
+    uint64_t hash = (((uint64_t)(uintptr_t)fn) * 0x9e3779b97f4a7c15ull) ^ (uint64_t)line;
+    uint32_t mask = PROFILE_FRAME_CAPACITY - 1;
+    for (uint32_t i = (uint32_t)(hash >> 32) & mask;; i = (i + 1) & mask) {
+        ProfileFrame *frame = &profileFrames[i];
+        if (frame->fn == fn && frame->line == line) return i;
+        if (frame->fn) continue;
+        if (profileFrameCount * 4 >= PROFILE_FRAME_CAPACITY * 3) return UINT32_MAX;
+        char text[256];
+        size_t length = 0;
+        const char *parts[3] = { fn->debug->name, " (", fn->module->name->value };
+        for (int p = 0; p < 3; p ++) {
+            for (const char *c = parts[p]; *c && length < sizeof(text) - 16; c ++) {
+                text[length ++] = *c;
+            }
+        }
+        text[length ++] = ':';
+        if (line < 0) {
+            text[length ++] = '?';
+        } else {
+            char digits[12];
+            int digitCount = 0;
+            unsigned value = (unsigned)line;
+            do { digits[digitCount ++] = '0' + value % 10; value /= 10; } while (value);
+            while (digitCount) text[length ++] = digits[-- digitCount];
+        }
+        text[length ++] = ')';
+        uint32_t name = appendName(text, length);
+        if (name == UINT32_MAX) return UINT32_MAX;
+        frame->fn = fn;
+        frame->line = line;
+        frame->name = name;
+        profileFrameCount ++;
+        return i;
+    }
+}
+
+static void countStack(const uint32_t *frames, uint32_t depth) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < depth; i ++) hash = (hash ^ frames[i]) * 0x100000001b3ull;
+    uint32_t mask = PROFILE_STACK_CAPACITY - 1;
+    for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+        ProfileStack *stack = &profileStacks[i];
+        if (stack->samples == 0) {
+            if ((profileStackCount * 4 >= PROFILE_STACK_CAPACITY * 3) ||
+                (profileStackFramesUsed + depth > PROFILE_STACK_ARENA))
+            {
+                profileDropped ++;
+                return;
+            }
+            memcpy(&profileStackFrames[profileStackFramesUsed], frames, depth * sizeof(uint32_t));
+            stack->hash = hash;
+            stack->frames = profileStackFramesUsed;
+            stack->depth = depth;
+            stack->samples = 1;
+            profileStackFramesUsed += depth;
+            profileStackCount ++;
+            return;
+        }
+        if ((stack->hash == hash) && (stack->depth == depth) &&
+            (memcmp(&profileStackFrames[stack->frames], frames, depth * sizeof(uint32_t)) == 0))
+        {
+            stack->samples ++;
+            return;
+        }
+    }
+}
+
+static void profileSignalHandler(int signal) {
+    int savedErrno = errno;
+    WrenVM *vm = profiledVM;
+    uint32_t frames[PROFILE_MAX_DEPTH];
+    uint32_t depth = 0;
+    bool ok = true;
+    // Innermost frame first; reversed below.
+    bool innermost = true;
+    for (ObjFiber *fiber = vm ? vm->fiber : NULL; ok && fiber; fiber = fiber->caller) {
+        // The signal may land while Wren is growing the frame array, so read it once and check
+        // it before walking it.
+        CallFrame *fiberFrames = fiber->frames;
+        int numFrames = fiber->numFrames;
+        if (!fiberFrames || (numFrames < 0) || (numFrames > fiber->frameCapacity)) {
+            ok = false;
+            break;
+        }
+        for (int i = numFrames - 1; ok && (i >= 0) && (depth < PROFILE_MAX_DEPTH); i --) {
+            CallFrame *frame = &fiberFrames[i];
+            ObjFn *fn = frame->closure ? frame->closure->fn : NULL;
+            if (!fn || !fn->module || !fn->debug) {
+                ok = false;
+            } else if (fn->module->name) { // Core library frames have no module name.
+                ptrdiff_t offset = frame->ip - fn->code.data - 1;
+                int line;
+                if ((offset >= 0) && (offset < fn->debug->sourceLines.count)) {
+                    line = fn->debug->sourceLines.data[offset];
+                } else if (innermost) {
+                    // Hasn't made a call yet, so its ip was never stored (see the top).
+                    line = -1;
+                } else {
+                    ok = false;
+                    break;
+                }
+                uint32_t id = internFrame(fn, line);
+                if (id == UINT32_MAX) ok = false;
+                else frames[depth ++] = id;
+            }
+            innermost = false;
+        }
+    }
+    if (ok && depth > 0) {
+        for (uint32_t i = 0; i < depth / 2; i ++) {
+            uint32_t t = frames[i];
+            frames[i] = frames[depth - 1 - i];
+            frames[depth - 1 - i] = t;
+        }
+        countStack(frames, depth);
+        profileSamples ++;
+    } else if (!ok) {
+        profileDropped ++;
+    }
+    errno = savedErrno;
+}
+
+// Sample this thread's CPU time, so isolates don't land samples on the main VM.
+static bool armProfileTimer(void) {
+    clockid_t clock;
+    if (pthread_getcpuclockid(pthread_self(), &clock) != 0) clock = CLOCK_MONOTONIC;
+    struct sigevent event = {0};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(clock, &event, &profileTimer) < 0) return false;
+    struct itimerspec spec = {0};
+    spec.it_interval.tv_sec = profileInterval / 1000000000L;
+    spec.it_interval.tv_nsec = profileInterval % 1000000000L;
+    spec.it_value = spec.it_interval;
+    timer_settime(profileTimer, 0, &spec, NULL);
+    profileTimerArmed = true;
+    return true;
+}
+
+// Timers aren't inherited across fork(), so a worker started by Process.fork(..) arms its own
+// and starts counting from zero.
+static void rearmProfilerInChild(void) {
+    if (!profileTimerArmed) return;
+    memset(profileStacks, 0, PROFILE_STACK_CAPACITY * sizeof(ProfileStack));
+    profileStackCount = 0;
+    profileStackFramesUsed = 0;
+    profileSamples = 0;
+    profileDropped = 0;
+    profileTimerArmed = false;
+    (void)armProfileTimer();
+}
+
+void stopProfiler(void) {
+    if (profileTimerArmed) {
+        timer_delete(profileTimer);
+        profileTimerArmed = false;
+    }
+    profiledVM = NULL;
+}
+
+static void writeProfile(void) {
+    stopProfiler();
+    if (!profilePath) return;
+    // Forked workers inherit the profile; give each its own file.
+    char *path = profilePath;
+    char pidPath[4096];
+    if (getpid() != profilePid) {
+        snprintf(pidPath, sizeof(pidPath), "%s.%d", profilePath, (int)getpid());
+        path = pidPath;
+    }
+    FILE *file = fopen(path, "w");
+    if (file) {
+        for (uint32_t i = 0; i < PROFILE_STACK_CAPACITY; i ++) {
+            ProfileStack *stack = &profileStacks[i];
+            if (!stack->samples) continue;
+            for (uint32_t f = 0; f < stack->depth; f ++) {
+                uint32_t id = profileStackFrames[stack->frames + f];
+                fprintf(file, "%s%s", f ? ";" : "", &profileNames[profileFrames[id].name]);
+            }
+            fprintf(file, " %llu\n", (unsigned long long)stack->samples);
+        }
+        fclose(file);
+        fprintf(stderr, "\x1b[36m[NOTE]\x1b[m Wrote %llu samples to `%s` (%llu dropped).\n",
+                (unsigned long long)profileSamples, path, (unsigned long long)profileDropped);
+    } else {
+        fprintf(stderr, "\x1b[31;1m[ERROR]\x1b[m Could not write profile to `%s`.\n", path);
+    }
+    free(profilePath);
+    profilePath = NULL;
+}
+
+bool startProfiler(WrenVM *vm, const char *path, int hz, const char **errorOut) {
+    profileFrames = calloc(PROFILE_FRAME_CAPACITY, sizeof(ProfileFrame));
+    profileNames = malloc(PROFILE_NAME_ARENA);
+    profileStacks = calloc(PROFILE_STACK_CAPACITY, sizeof(ProfileStack));
+    profileStackFrames = malloc(PROFILE_STACK_ARENA * sizeof(uint32_t));
+    profilePath = strdup(path);
+    profilePid = getpid();
+
+    struct sigaction action = {0};
+    action.sa_handler = &profileSignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) < 0) {
+        *errorOut = "Could not install the SIGPROF handler.";
+        return false;
+    }
+    profiledVM = vm;
+    profileInterval = 1000000000L / hz;
+    if (!armProfileTimer()) {
+        profiledVM = NULL;
+        *errorOut = "Could not create the profiling timer.";
+        return false;
+    }
+    pthread_atfork(NULL, NULL, &rearmProfilerInChild);
+    atexit(&writeProfile);
+    return true;
+}
+
+#else
+
+bool startProfiler(WrenVM *vm, const char *path, int hz, const char **errorOut) {
+    *errorOut = "This build of GGWren cannot profile Wren code. Rebuild it with "
+            "GG_WREN_INTERNALS defined (see INSTALL.md).";
+    return false;
+}
+
+void stopProfiler(void) {}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// TimerHeap: a binary min-heap of (time, token) pairs, used by TaskQueue for sleeping tasks.
+// Tokens are small non-negative integers (TaskQueue uses entry ids) and each has at most one
+// timer; `positions` maps a token to its heap slot, so moving or cancelling a timer is
+// O(log n), the next deadline is O(1), and popping the due timers costs O(log n) each.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+#include "gg.h"
+
+#define TIMER_MAX_DUE 256
+
+typedef struct Timer Timer;
+struct Timer {
+    double time;
+    uint32_t token;
+};
+
+typedef struct TimerHeap TimerHeap;
+struct TimerHeap {
+    Timer *timers;
+    int count;
+    int capacity;
+    int32_t *positions;     // Indexed by token; -1 if the token has no timer.
+    int positionCapacity;
+    double due[TIMER_MAX_DUE];
+};
+
+static void placeTimer(TimerHeap *heap, int index, Timer timer) {
+    heap->timers[index] = timer;
+    heap->positions[timer.token] = index;
+}
+
+static void siftUp(TimerHeap *heap, int index) {
+    Timer timer = heap->timers[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (heap->timers[parent].time <= timer.time) break;
+        placeTimer(heap, index, heap->timers[parent]);
+        index = parent;
+    }
+    placeTimer(heap, index, timer);
+}
+
+static void siftDown(TimerHeap *heap, int index) {
+    Timer timer = heap->timers[index];
+    for (;;) {
+        int child = index * 2 + 1;
+        if (child >= heap->count) break;
+        int right = child + 1;
+        if ((right < heap->count) && (heap->timers[right].time < heap->timers[child].time)) {
+            child = right;
+        }
+        if (timer.time <= heap->timers[child].time) break;
+        placeTimer(heap, index, heap->timers[child]);
+        index = child;
+    }
+    placeTimer(heap, index, timer);
+}
+
+static void removeTimerAt(TimerHeap *heap, int index) {
+    heap->positions[heap->timers[index].token] = -1;
+    heap->count --;
+    if (index == heap->count) return;
+    placeTimer(heap, index, heap->timers[heap->count]);
+    if ((index > 0) && (heap->timers[index].time < heap->timers[(index - 1) / 2].time)) {
+        siftUp(heap, index);
+    } else {
+        siftDown(heap, index);
+    }
+}
+
+static bool getToken(WrenVM *vm, int slot, uint32_t *tokenOut) {
+    double token = wrenGetSlotDouble(vm, slot);
+    if ((token < 0) || (token >= 16777216) || (token != floor(token))) {
+        wrenSetSlotString(vm, 0, "Timer tokens must be integers from 0 to 16777215.");
+        wrenAbortFiber(vm, 0);
+        return false;
+    }
+    *tokenOut = (uint32_t)token;
+    return true;
+}
+
+static
+void apiAllocate_TimerHeap(WrenVM *vm) {
+    TimerHeap *heap = wrenSetSlotNewForeign(vm, 0, 0, sizeof(TimerHeap));
+    memset(heap, 0, sizeof(TimerHeap));
+}
+
+static
+void apiFinalize_TimerHeap(void *data) {
+    TimerHeap *heap = data;
+    free(heap->timers);
+    free(heap->positions);
+}
+
+// add(time, token) sets the timer for `token`, replacing any it already had.
+static
+void api_TimerHeap_add_2(WrenVM *vm) {
+    TimerHeap *heap = wrenGetSlotForeign(vm, 0);
+    double time = wrenGetSlotDouble(vm, 1);
+    uint32_t token;
+    if (!getToken(vm, 2, &token)) return;
+    if (token >= heap->positionCapacity) {
+        int capacity = (int)nextPowerOfTwo(token + 1);
+        if (capacity < 64) capacity = 64;
+        heap->positions = realloc(heap->positions, capacity * sizeof(int32_t));
+        for (int i = heap->positionCapacity; i < capacity; i ++) heap->positions[i] = -1;
+        heap->positionCapacity = capacity;
+    }
+    int index = heap->positions[token];
+    if (index >= 0) {
+        double old = heap->timers[index].time;
+        heap->timers[index].time = time;
+        if (time < old) siftUp(heap, index);
+        else siftDown(heap, index);
+    } else {
+        if (heap->count == heap->capacity) {
+            heap->capacity = heap->capacity ? heap->capacity * 2 : 64;
+            heap->timers = realloc(heap->timers, heap->capacity * sizeof(Timer));
+        }
+        Timer timer = { time, token };
+        placeTimer(heap, heap->count ++, timer);
+        siftUp(heap, heap->count - 1);
+    }
+    wrenSetSlotNull(vm, 0);
+}
+
+// remove(token) cancels the timer for `token`, if it has one. Returns whether it did.
+static
+void api_TimerHeap_remove_1(WrenVM *vm) {
+    TimerHeap *heap = wrenGetSlotForeign(vm, 0);
+    uint32_t token;
+    if (!getToken(vm, 1, &token)) return;
+    int index = (token < heap->positionCapacity) ? heap->positions[token] : -1;
+    if (index >= 0) removeTimerAt(heap, index);
+    wrenSetSlotBool(vm, 0, index >= 0);
+}
+
+static
+void api_TimerHeap_count_getter(WrenVM *vm) {
+    TimerHeap *heap = wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, heap->count);
+}
+
+// The earliest time in the heap, or infinity if it is empty.
+static
+void api_TimerHeap_next_getter(WrenVM *vm) {
+    TimerHeap *heap = wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, heap->count ? heap->timers[0].time : INFINITY);
+}
+
+// popDue(now, due) removes the timers due at or before `now`, earliest first, and writes their
+// tokens to the start of `due`. At most due.count (and 256) are taken per call; returns how many.
+static
+void api_TimerHeap_popDue_2(WrenVM *vm) {
+    TimerHeap *heap = wrenGetSlotForeign(vm, 0);
+    double now = wrenGetSlotDouble(vm, 1);
+    int limit = wrenGetListCount(vm, 2);
+    if (limit > TIMER_MAX_DUE) limit = TIMER_MAX_DUE;
+    int count = 0;
+    while ((count < limit) && (heap->count > 0) && (heap->timers[0].time <= now)) {
+        heap->due[count ++] = heap->timers[0].token;
+        removeTimerAt(heap, 0);
+    }
+    ggSetListNums(vm, 2, 0, count, heap->due);
+    wrenSetSlotDouble(vm, 0, count);
+}
+
+void initTimers(void) {
+    ggRegisterClass("TimerHeap", &apiAllocate_TimerHeap, &apiFinalize_TimerHeap);
+    ggRegisterMethod("TimerHeap", "add(_,_)", &api_TimerHeap_add_2);
+    ggRegisterMethod("TimerHeap", "remove(_)", &api_TimerHeap_remove_1);
+    ggRegisterMethod("TimerHeap", "count", &api_TimerHeap_count_getter);
+    ggRegisterMethod("TimerHeap", "next", &api_TimerHeap_next_getter);
+    ggRegisterMethod("TimerHeap", "popDue(_,_)", &api_TimerHeap_popDue_2);
+}
@@ -0,0 +1,197 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// -trace-foreign: every foreign method Wren binds is swapped for one of a fixed pool of
+// trampolines. Each trampoline knows its own slot, looks up the real function there, and
+// records the call count, total time and a log2 latency histogram for that
+// "module:Class.signature" (the module is part of the key, as two modules may declare the same
+// class name).
+// Slots are shared by every VM that binds the same method, so counters use atomics.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+#include "gg.h"
+
+#define TRACE_SLOTS 1000
+#define TRACE_BUCKETS 32
+
+typedef struct TraceSlot TraceSlot;
+struct TraceSlot {
+    char *module;
+    char *name;
+    char *key;      // "module:name", as reported by GG.foreignStats and the exit summary.
+    WrenForeignMethodFn fn;
+    uint64_t calls;
+    uint64_t nanoseconds;
+    uint64_t histogram[TRACE_BUCKETS]; // Bucket i counts calls taking [2^i, 2^(i+1)) ns.
+};
+
+static TraceSlot traceSlots[TRACE_SLOTS];
+static int traceSlotCount = 0;
+static bool traceOverflowReported = false;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void traceForeignCall(int index, WrenVM *vm) {
+    TraceSlot *slot = &traceSlots[index];
+    uint64_t start = monotonicNanoseconds();
+    slot->fn(vm);
+    uint64_t elapsed = monotonicNanoseconds() - start;
+    int bucket = elapsed ? 63 - __builtin_clzll(elapsed) : 0;
+    if (bucket >= TRACE_BUCKETS) bucket = TRACE_BUCKETS - 1;
+    __atomic_fetch_add(&slot->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->nanoseconds, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->histogram[bucket], 1, __ATOMIC_RELAXED);
+}
+
+#define TRAMPOLINE(a, b, c)                                                                        \
+    static void foreignTrampoline_##a##b##c(WrenVM *vm) { traceForeignCall(a*100 + b*10 + c, vm); }
+#define TRAMPOLINE_POINTER(a, b, c) &foreignTrampoline_##a##b##c,
+
+#define TRAMPOLINES_10(X, a, b)                                                                    \
+    X(a, b, 0) X(a, b, 1) X(a, b, 2) X(a, b, 3) X(a, b, 4)                                         \
+    X(a, b, 5) X(a, b, 6) X(a, b, 7) X(a, b, 8) X(a, b, 9)
+#define TRAMPOLINES_100(X, a)                                                                      \
+    TRAMPOLINES_10(X, a, 0) TRAMPOLINES_10(X, a, 1) TRAMPOLINES_10(X, a, 2)                        \
+    TRAMPOLINES_10(X, a, 3) TRAMPOLINES_10(X, a, 4) TRAMPOLINES_10(X, a, 5)                        \
+    TRAMPOLINES_10(X, a, 6) TRAMPOLINES_10(X, a, 7) TRAMPOLINES_10(X, a, 8)                        \
+    TRAMPOLINES_10(X, a, 9)
+#define TRAMPOLINES_1000(X)                                                                        \
+    TRAMPOLINES_100(X, 0) TRAMPOLINES_100(X, 1) TRAMPOLINES_100(X, 2) TRAMPOLINES_100(X, 3)        \
+    TRAMPOLINES_100(X, 4) TRAMPOLINES_100(X, 5) TRAMPOLINES_100(X, 6) TRAMPOLINES_100(X, 7)        \
+    TRAMPOLINES_100(X, 8) TRAMPOLINES_100(X, 9)
+
+TRAMPOLINES_1000(TRAMPOLINE)
+
+static const WrenForeignMethodFn trampolines[TRACE_SLOTS] = {
+    TRAMPOLINES_1000(TRAMPOLINE_POINTER)
+};
+
+// Returns a trampoline standing in for `fn`, which `module` binds as `name` ("Class.signature").
+// If the pool is used up, `fn` itself is returned and goes untraced.
+WrenForeignMethodFn traceForeignMethod(const char *module, const char *name,
+        WrenForeignMethodFn fn) {
+    WrenForeignMethodFn result = fn;
+    pthread_mutex_lock(&traceLock);
+    int index = -1;
+    for (int i = 0; (index < 0) && (i < traceSlotCount); i ++) {
+        if ((traceSlots[i].fn == fn) && (strcmp(traceSlots[i].name, name) == 0) &&
+            (strcmp(traceSlots[i].module, module) == 0))
+        {
+            index = i;
+        }
+    }
+    if ((index < 0) && (traceSlotCount < TRACE_SLOTS)) {
+        index = traceSlotCount;
+        traceSlots[index].module = strdup(module);
+        traceSlots[index].name = strdup(name);
+        size_t keySize = strlen(module) + strlen(name) + 2;
+        traceSlots[index].key = malloc(keySize);
+        snprintf(traceSlots[index].key, keySize, "%s:%s", module, name);
+        traceSlots[index].fn = fn;
+        traceSlotCount ++;
+    } else if ((index < 0) && !traceOverflowReported) {
+        fprintf(stderr, "\x1b[33;1m[WARNING]\x1b[m More than %d foreign methods were bound; "
+                "the rest are not traced.\n", TRACE_SLOTS);
+        traceOverflowReported = true;
+    }
+    if (index >= 0) result = trampolines[index];
+    pthread_mutex_unlock(&traceLock);
+    return result;
+}
+
+// GG.foreignStats: a map from "module:Class.signature" to {"calls", "time", "histogram"}, where
+// time is in seconds and histogram[i] counts calls that took [2^i, 2^(i+1)) nanoseconds.
+void apiStatic_GG_foreignStats_getter(WrenVM *vm) {
+    wrenEnsureSlots(vm, 5);
+    wrenSetSlotNewMap(vm, 0);
+    pthread_mutex_lock(&traceLock);
+    int count = traceSlotCount;
+    pthread_mutex_unlock(&traceLock);
+    for (int i = 0; i < count; i ++) {
+        TraceSlot *slot = &traceSlots[i];
+        wrenSetSlotNewMap(vm, 1);
+        wrenSetSlotString(vm, 2, "calls");
+        wrenSetSlotDouble(vm, 3, __atomic_load_n(&slot->calls, __ATOMIC_RELAXED));
+        wrenSetMapValue(vm, 1, 2, 3);
+        wrenSetSlotString(vm, 2, "time");
+        wrenSetSlotDouble(vm, 3, __atomic_load_n(&slot->nanoseconds, __ATOMIC_RELAXED) / 1e9);
+        wrenSetMapValue(vm, 1, 2, 3);
+        wrenSetSlotString(vm, 2, "histogram");
+        wrenSetSlotNewList(vm, 3);
+        for (int b = 0; b < TRACE_BUCKETS; b ++) {
+            wrenSetSlotDouble(vm, 4, __atomic_load_n(&slot->histogram[b], __ATOMIC_RELAXED));
+            wrenInsertInList(vm, 3, -1, 4);
+        }
+        wrenSetMapValue(vm, 1, 2, 3);
+        wrenSetSlotString(vm, 2, slot->key);
+        wrenSetMapValue(vm, 0, 2, 1);
+    }
+}
+
+static int compareSlotsByTime(const void *a, const void *b) {
+    const TraceSlot *x = *(const TraceSlot**)a;
+    const TraceSlot *y = *(const TraceSlot**)b;
+    return (x->nanoseconds < y->nanoseconds) - (x->nanoseconds > y->nanoseconds);
+}
+
+// Approximate latency percentile, as the upper bound of the bucket it falls in.
+static double histogramPercentile(const TraceSlot *slot, double fraction) {
+    uint64_t target = (uint64_t)(slot->calls * fraction);
+    uint64_t seen = 0;
+    for (int b = 0; b < TRACE_BUCKETS; b ++) {
+        seen += slot->histogram[b];
+        if (seen > target) return (double)(2ull << b) / 1000.0;
+    }
+    return (double)(2ull << (TRACE_BUCKETS - 1)) / 1000.0;
+}
+
+void dumpForeignStats(void) {
+    TraceSlot **sorted = malloc(sizeof(TraceSlot*) * (traceSlotCount + 1));
+    int count = 0;
+    for (int i = 0; i < traceSlotCount; i ++) {
+        if (traceSlots[i].calls) sorted[count ++] = &traceSlots[i];
+    }
+    qsort(sorted, count, sizeof(TraceSlot*), &compareSlotsByTime);
+    fprintf(stderr, "\n%-40s %12s %12s %10s %10s %10s\n", "Foreign method", "Calls",
+            "Total (ms)", "Mean (us)", "p50 (us)", "p99 (us)");
+    for (int i = 0; i < count; i ++) {
+        TraceSlot *slot = sorted[i];
+        fprintf(stderr, "%-40s %12llu %12.3f %10.3f %10.3f %10.3f\n", slot->key,
+                (unsigned long long)slot->calls, slot->nanoseconds / 1e6,
+                slot->nanoseconds / 1e3 / slot->calls, histogramPercentile(slot, 0.5),
+                histogramPercentile(slot, 0.99));
+    }
+    fprintf(stderr, "\n");
+    free(sorted);
+}
@@ -0,0 +1,439 @@
+/*
+* GGWren
+* Copyright (C) 2025 Thomas Doylend
+* 
+* This software is provided ‘as-is’, without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+
+/**************************************************************************************************/
+
+// The background work pool. Foreign methods hand slow, VM-independent work (disk reads, DNS
+// lookups, password hashing, ..) to ggSubmitWork(..), which runs it on one of a few host threads
+// and tracks it with a Job object. A Job's fd becomes readable when the work is done, so a Task
+// waits for it with sleepOnIO(..) like any other fd; the extension's completion callback then
+// turns the result into a Wren value back on the VM's thread (see Pending in std.work).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wren.h>
+
+// Platform-specific includes
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#error
+#endif
+
+#define GG_HOST
+#include <ggwren.h>
+
+#include "gg.h"
+
+#define MAX_WORK_THREADS 64
+
+// Shared between the Job object and the pool until both are done with it. `done` is set by the
+// pool thread once `work` has returned; `completed` is only touched on the VM's thread. A job
+// is `lost` if it was submitted but will never run to the end: it was still pending when the
+// process forked (in the child), or when the pool was stopped.
+typedef struct WorkJob WorkJob;
+struct WorkJob {
+    WorkJob *next;
+    WorkJob *activePrev;
+    WorkJob *activeNext;
+    ggWorkFn work;
+    ggCompleteFn complete;
+    void *data;
+    int fd;
+    int refs;
+    bool submitted;
+    bool done;
+    bool completed;
+    bool lost;
+};
+
+int workThreads = 0;
+
+static pthread_mutex_t workLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t workThreadExited = PTHREAD_COND_INITIALIZER;
+static WorkJob *workHead = NULL;
+static WorkJob *workTail = NULL;
+static WorkJob *workActive = NULL;  // Every job submitted and not yet done, queued or running.
+static int workThreadsStarted = 0;
+static bool workStopping = false;
+static bool workForkHandlerSet = false;
+
+/**************************************************************************************************/
+
+static void releaseJob(WorkJob *job) {
+    if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        // Nobody took the result, so let the extension free `data`. A lost job may have been
+        // part-way through `work`, so its data is leaked instead.
+        if (job->submitted && !job->completed && !job->lost && job->complete) {
+            job->complete(NULL, job->data);
+        }
+        (void)close(job->fd);
+        free(job);
+    }
+}
+
+// Called with workLock held.
+static void removeActiveJob(WorkJob *job) {
+    if (job->activePrev) job->activePrev->activeNext = job->activeNext;
+    else workActive = job->activeNext;
+    if (job->activeNext) job->activeNext->activePrev = job->activePrev;
+    job->activePrev = job->activeNext = NULL;
+}
+
+// Mark a job that will never finish as done, waking anything waiting on it; complete_() then
+// reports the error. Drops the pool's reference. Called with workLock held.
+static void loseJob(WorkJob *job) {
+    removeActiveJob(job);
+    job->lost = true;
+    __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    (void)write(job->fd, &one, sizeof(one));
+    releaseJob(job);
+}
+
+static void* workThreadMain(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&workLock);
+    while (true) {
+        while (!workHead && !workStopping) pthread_cond_wait(&workReady, &workLock);
+        if (workStopping) break;
+        WorkJob *job = workHead;
+        workHead = job->next;
+        if (!workHead) workTail = NULL;
+        pthread_mutex_unlock(&workLock);
+
+        job->work(job->data);
+        pthread_mutex_lock(&workLock);
+        removeActiveJob(job);
+        __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+        uint64_t one = 1;
+        (void)write(job->fd, &one, sizeof(one));
+        pthread_mutex_unlock(&workLock);
+        releaseJob(job);
+        pthread_mutex_lock(&workLock);
+    }
+    workThreadsStarted --;
+    pthread_cond_broadcast(&workThreadExited);
+    pthread_mutex_unlock(&workLock);
+    return NULL;
+}
+
+// Hold workLock across fork(..) so that the child sees the job lists in a consistent state.
+static void lockWorkPool(void) {
+    pthread_mutex_lock(&workLock);
+}
+
+static void unlockWorkPool(void) {
+    pthread_mutex_unlock(&workLock);
+}
+
+// Forked children (see Process.fork) don't inherit the pool's threads; start new ones on demand.
+// Work that was queued or running in the parent will never finish in the child, so those jobs
+// fail there rather than leaving their waiters asleep for good.
+static void resetWorkPoolInChild(void) {
+    pthread_mutex_init(&workLock, NULL);
+    pthread_cond_init(&workReady, NULL);
+    pthread_cond_init(&workThreadExited, NULL);
+    while (workActive) loseJob(workActive);
+    workHead = workTail = NULL;
+    workThreadsStarted = 0;
+}
+
+// Called with workLock held.
+static void startWorkThreads(void) {
+    if (!workForkHandlerSet) {
+        pthread_atfork(&lockWorkPool, &unlockWorkPool, &resetWorkPoolInChild);
+        workForkHandlerSet = true;
+    }
+    int wanted = workThreads;
+    if (wanted <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        wanted = (cpus > 0) ? (int)cpus : 4;
+    }
+    if (wanted > MAX_WORK_THREADS) wanted = MAX_WORK_THREADS;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (workThreadsStarted < wanted) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, &workThreadMain, NULL) != 0) break;
+        workThreadsStarted ++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+bool ggSubmitWork(WrenVM *vm, int jobSlot, ggWorkFn work, ggCompleteFn complete, void *data) {
+    WorkJob *job = *(WorkJob**)wrenGetSlotForeign(vm, jobSlot);
+    if (job->submitted) {
+        wrenSetSlotString(vm, 0, "This Job has already been given work.");
+        wrenAbortFiber(vm, 0);
+        return false;
+    }
+    job->work = work;
+    job->complete = complete;
+    job->data = data;
+    job->submitted = true;
+    job->refs ++;
+    pthread_mutex_lock(&workLock);
+    if (workThreadsStarted == 0) startWorkThreads();
+    if (workThreadsStarted == 0) {
+        pthread_mutex_unlock(&workLock);
+        job->submitted = false;
+        job->refs --;
+        wrenSetSlotString(vm, 0, "Could not start any background work threads.");
+        wrenAbortFiber(vm, 0);
+        return false;
+    }
+    job->next = NULL;
+    if (workTail) workTail->next = job;
+    else workHead = job;
+    workTail = job;
+    job->activePrev = NULL;
+    job->activeNext = workActive;
+    if (workActive) workActive->activePrev = job;
+    workActive = job;
+    pthread_cond_signal(&workReady);
+    pthread_mutex_unlock(&workLock);
+    return true;
+}
+
+// Stop the pool before the host unloads extensions, whose code the threads may be running.
+// Queued work is dropped (its jobs fail), running work is waited for, and the threads exit; a
+// later ggSubmitWork(..) starts a new pool.
+void finishWork(void) {
+    pthread_mutex_lock(&workLock);
+    while (workHead) {
+        WorkJob *job = workHead;
+        workHead = job->next;
+        loseJob(job);
+    }
+    workTail = NULL;
+    workStopping = true;
+    pthread_cond_broadcast(&workReady);
+    while (workThreadsStarted > 0) pthread_cond_wait(&workThreadExited, &workLock);
+    workStopping = false;
+    pthread_mutex_unlock(&workLock);
+}
+
+/**************************************************************************************************/
+
+static void apiAllocate_Job(WrenVM *vm) {
+    WorkJob **handle = wrenSetSlotNewForeign(vm, 0, 0, sizeof(WorkJob*));
+    *handle = NULL;
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        wrenSetSlotString(vm, 0, strerror(errno));
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    WorkJob *job = calloc(1, sizeof(WorkJob));
+    job->fd = fd;
+    job->refs = 1;
+    *handle = job;
+}
+
+static void apiFinalize_Job(void *data) {
+    WorkJob *job = *(WorkJob**)data;
+    if (job) releaseJob(job);
+}
+
+static void api_Job_fd_getter(WrenVM *vm) {
+    WorkJob *job = *(WorkJob**)wrenGetSlotForeign(vm, 0);
+    wrenSetSlotDouble(vm, 0, job->fd);
+}
+
+static void api_Job_isDone_getter(WrenVM *vm) {
+    WorkJob *job = *(WorkJob**)wrenGetSlotForeign(vm, 0);
+    wrenSetSlotBool(vm, 0, __atomic_load_n(&job->done, __ATOMIC_ACQUIRE));
+}
+
+static void api_Job_wait_0(WrenVM *vm) {
+    WorkJob *job = *(WorkJob**)wrenGetSlotForeign(vm, 0);
+    if (!job->submitted) {
+        wrenSetSlotString(vm, 0, "This Job has not been given any work.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    struct pollfd pfd = { .fd = job->fd, .events = POLLIN };
+    while (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) (void)poll(&pfd, 1, -1);
+    wrenSetSlotNull(vm, 0);
+}
+
+static void api_Job_complete_0(WrenVM *vm) {
+    WorkJob *job = *(WorkJob**)wrenGetSlotForeign(vm, 0);
+    if (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE) || job->completed) {
+        wrenSetSlotString(vm, 0, job->completed ? "The Job's result has already been taken." :
+                "The Job has not finished.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    uint64_t count;
+    (void)read(job->fd, &count, sizeof(count));
+    job->completed = true;
+    if (job->lost) {
+        wrenSetSlotString(vm, 0, "The work was lost: the process forked or the host shut down "
+                "before it finished.");
+        wrenAbortFiber(vm, 0);
+        return;
+    }
+    wrenSetSlotNull(vm, 0);
+    job->complete(vm, job->data);
+}
+
+/**************************************************************************************************/
+
+// Fs.readEntireFileAsync(..)
+typedef struct ReadFileWork ReadFileWork;
+struct ReadFileWork {
+    char *path;
+    char *bytes;
+    size_t size;
+    int error;
+};
+
+static void readFileWork(void *data) {
+    ReadFileWork *read_ = data;
+    int fd = open(read_->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) < 0)) {
+        read_->error = errno;
+        if (fd >= 0) (void)close(fd);
+        return;
+    }
+    size_t capacity = (st.st_size > 0) ? (size_t)st.st_size : 4096;
+    read_->bytes = malloc(capacity);
+    while (true) {
+        if (read_->size == capacity) {
+            capacity *= 2;
+            read_->bytes = realloc(read_->bytes, capacity);
+        }
+        ssize_t count = read(fd, &read_->bytes[read_->size], capacity - read_->size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) read_->error = errno;
+        if (count <= 0) break;
+        read_->size += count;
+    }
+    (void)close(fd);
+}
+
+static void readFileComplete(WrenVM *vm, void *data) {
+    ReadFileWork *read_ = data;
+    if (vm && read_->error) {
+        wrenSetSlotString(vm, 0, strerror(read_->error));
+        wrenAbortFiber(vm, 0);
+    } else if (vm) {
+        wrenSetSlotBytes(vm, 0, read_->bytes, read_->size);
+    }
+    free(read_->path);
+    free(read_->bytes);
+    free(read_);
+}
+
+static void apiStatic_Fs_readEntireFile_2(WrenVM *vm) {
+    ReadFileWork *read_ = calloc(1, sizeof(ReadFileWork));
+    read_->path = strdup(wrenGetSlotString(vm, 2));
+    if (ggSubmitWork(vm, 1, &readFileWork, &readFileComplete, read_)) {
+        wrenSetSlotNull(vm, 0);
+    } else {
+        readFileComplete(NULL, read_);
+    }
+}
+
+// Dns.resolve(..)
+typedef struct ResolveWork ResolveWork;
+struct ResolveWork {
+    char *host;
+    struct addrinfo *addresses;
+    int error;
+};
+
+static void resolveWork(void *data) {
+    ResolveWork *resolve = data;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    resolve->error = getaddrinfo(resolve->host, NULL, &hints, &resolve->addresses);
+}
+
+static void resolveComplete(WrenVM *vm, void *data) {
+    ResolveWork *resolve = data;
+    if (vm && resolve->error) {
+        wrenSetSlotString(vm, 0, gai_strerror(resolve->error));
+        wrenAbortFiber(vm, 0);
+    } else if (vm) {
+        wrenEnsureSlots(vm, 2);
+        wrenSetSlotNewList(vm, 0);
+        for (struct addrinfo *address = resolve->addresses; address; address = address->ai_next) {
+            char text[INET6_ADDRSTRLEN];
+            const void *raw = (address->ai_family == AF_INET6) ?
+                    (const void*)&((struct sockaddr_in6*)address->ai_addr)->sin6_addr :
+                    (const void*)&((struct sockaddr_in*)address->ai_addr)->sin_addr;
+            if (inet_ntop(address->ai_family, raw, text, sizeof(text))) {
+                wrenSetSlotString(vm, 1, text);
+                wrenInsertInList(vm, 0, -1, 1);
+            }
+        }
+    }
+    if (resolve->addresses) freeaddrinfo(resolve->addresses);
+    free(resolve->host);
+    free(resolve);
+}
+
+static void apiStatic_Dns_resolve_2(WrenVM *vm) {
+    ResolveWork *resolve = calloc(1, sizeof(ResolveWork));
+    resolve->host = strdup(wrenGetSlotString(vm, 2));
+    if (ggSubmitWork(vm, 1, &resolveWork, &resolveComplete, resolve)) {
+        wrenSetSlotNull(vm, 0);
+    } else {
+        resolveComplete(NULL, resolve);
+    }
+}
+
+void initWork(void) {
+    ggRegisterClass("Job", &apiAllocate_Job, &apiFinalize_Job);
+    ggRegisterMethod("Job", "fd", &api_Job_fd_getter);
+    ggRegisterMethod("Job", "isDone", &api_Job_isDone_getter);
+    ggRegisterMethod("Job", "wait_()", &api_Job_wait_0);
+    ggRegisterMethod("Job", "complete_()", &api_Job_complete_0);
+
+    ggRegisterMethod("Fs", "static readEntireFile_(_,_)", &apiStatic_Fs_readEntireFile_2);
+    ggRegisterMethod("Dns", "static resolve_(_,_)", &apiStatic_Dns_resolve_2);
+}